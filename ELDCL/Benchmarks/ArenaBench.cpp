@@ -0,0 +1,36 @@
+// Load and teardown time of a generated world with and without the arena (TreeStorage).
+// Both modes must decode the same tree
+#include "BenchCommon.hpp"
+
+using namespace DCL;
+
+int main(int argc, char** argv)
+{
+    size_t entities = argc > 1 ? std::stoul(argv[1]) : 50000;
+    std::string code = Bench::GenerateEntities(entities);
+    std::printf("corpus: %zu entities, %.1f MB\n", entities, code.size() / 1e6);
+
+    std::string expected;
+    for (bool arena : { false, true }) {
+        LoadOptions options;
+        options.arena_mode = arena;
+        const char* name = arena ? "arena" : "shared";
+
+        std::string text = Serializator::Get().Serialize(Loader::LoadFromString(code, options));
+        if (expected.empty()) expected = text;
+        Bench::Check(text == expected && !text.empty(), name);
+
+        double load = 1e300, teardown = 1e300;
+        for (int run = 0; run < 5; run++) {
+            auto start = Bench::Clock::now();
+            auto tree = Loader::LoadFromString(code, options);
+            load = std::min(load, Bench::MillisecondsSince(start));
+
+            start = Bench::Clock::now();
+            tree.reset();
+            teardown = std::min(teardown, Bench::MillisecondsSince(start));
+        }
+        std::printf("%-6s load %8.1f ms  teardown %8.1f ms\n", name, load, teardown);
+    }
+    return Bench::Result();
+}
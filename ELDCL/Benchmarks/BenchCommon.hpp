@@ -0,0 +1,70 @@
+#pragma once
+#include "..\include\DCL.hpp"
+#include <chrono>
+#include <cstdio>
+
+// Shared pieces of the benchmarks. Every .cpp here is a program of its own, built from the ELDCL directory:
+//   g++ -std=c++20 -O2 -pthread Benchmarks/LexerBench.cpp -o lexer_bench
+//   cl /std:c++20 /O2 /EHsc Benchmarks\LexerBench.cpp
+// A benchmark checks its results before timing them and exits with 1 if they are wrong
+namespace Bench
+{
+    using Clock = std::chrono::steady_clock;
+
+    inline double MillisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // Best of runs, milliseconds
+    template<typename Body>
+    double Measure(int runs, Body&& body)
+    {
+        double best = 1e300;
+        for (int run = 0; run < runs; run++) {
+            auto start = Clock::now();
+            body();
+            best = std::min(best, MillisecondsSince(start));
+        }
+        return best;
+    }
+
+    inline int failures = 0;
+
+    inline void Check(bool condition, const char* what)
+    {
+        if (condition) return;
+        std::printf("FAILED: %s\n", what);
+        failures++;
+    }
+
+    inline int Result()
+    {
+        if (failures != 0) std::printf("%d check(s) failed\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+
+    // Entities with components, keys, copies, references, expressions, arrays, escaped strings and comments.
+    // Strings, comments and indentation vary in length, so the vector scanners end at every offset
+    inline std::string GenerateEntities(size_t count)
+    {
+        std::string code = "tag::constants Base { K: 1; S: \"abc\"; Scale: 2.5; }\n";
+        for (size_t i = 0; i < count; i++) {
+            std::string n = std::to_string(i);
+            code += "tag::entity Entity" + n + "\n{\n";
+            code += "\tkey Name = \"ent" + n + "\";\n";
+            code += "\tID: " + n + ";\n";
+            code += "\tPARENT_ID: " + std::to_string(i / 2) + ";\n";
+            code += "\tcopy Base;\n";
+            code += "\tDescription: \"" + std::string(i % 61, 'x') + " \\\"quoted\\\" " + n + "\";\n";
+            code += "\t// " + std::string(i % 97, '-') + " transform\n";
+            code += "\ttag::component Transform\n\t{\n";
+            code += "\t\tOrigin: [" + n + ".5, 20.0, 3.04];" + std::string(i % 45, ' ') + "\n";
+            code += "\t\tScale: Base::Scale * " + std::to_string(i % 7 + 1) + ";\n";
+            code += "\t}\n";
+            if (i % 3 == 0) code += "\ttag::component Physics { Mass: " + std::to_string(i % 50) + "; Static: false; }\n";
+            code += "}\n";
+        }
+        return code;
+    }
+}
@@ -0,0 +1,257 @@
+// Bytecode of Expression against a plain tree walk over the same grammar (the evaluator a decoder without
+// compilation would have): random expressions must give the same values, then both are timed. Then a file
+// with tens of thousands of derived constants is loaded
+#include "BenchCommon.hpp"
+#include <optional>
+
+using namespace DCL;
+
+// AST of an expression, evaluated recursively. No folding, every evaluation walks all of the nodes
+class TreeWalk
+{
+    struct Node
+    {
+        char op = 0;                    // '+', '-', '*', '/', 'n' (negate), 'c' (constant), 'r' (reference)
+        double value = 0;
+        std::vector<Symbol> names;
+        std::unique_ptr<Node> left, right;
+    };
+
+    std::span<const Token> tokens;
+    const SymbolTable& symbols;
+    size_t position = 0;
+    std::unique_ptr<Node> root;
+
+    bool Is(std::string_view text) const { return position < tokens.size() && tokens[position].value == text; }
+
+    static std::unique_ptr<Node> Binary(char op, std::unique_ptr<Node> left, std::unique_ptr<Node> right)
+    {
+        auto node = std::make_unique<Node>();
+        node->op = op;
+        node->left = std::move(left);
+        node->right = std::move(right);
+        return node;
+    }
+
+    std::unique_ptr<Node> ParseSum()
+    {
+        auto left = ParseProduct();
+        while (left && (Is("+") || Is("-"))) {
+            char op = tokens[position++].value[0];
+            auto right = ParseProduct();
+            if (!right) return nullptr;
+            left = Binary(op, std::move(left), std::move(right));
+        }
+        return left;
+    }
+
+    std::unique_ptr<Node> ParseProduct()
+    {
+        auto left = ParseUnary();
+        while (left && (Is("*") || Is("/"))) {
+            char op = tokens[position++].value[0];
+            auto right = ParseUnary();
+            if (!right) return nullptr;
+            left = Binary(op, std::move(left), std::move(right));
+        }
+        return left;
+    }
+
+    std::unique_ptr<Node> ParseUnary()
+    {
+        if (Is("-")) {
+            position++;
+            auto operand = ParseUnary();
+            return operand ? Binary('n', std::move(operand), nullptr) : nullptr;
+        }
+        if (Is("+")) {
+            position++;
+            return ParseUnary();
+        }
+        if (position >= tokens.size()) return nullptr;
+        const Token& t = tokens[position];
+        if (t.value == "(") {
+            position++;
+            auto inner = ParseSum();
+            if (!Is(")")) return nullptr;
+            position++;
+            return inner;
+        }
+        auto node = std::make_unique<Node>();
+        if (t.type == TokenType::NUMBER_LITERAL) {
+            node->op = 'c';
+            std::from_chars(t.value.data(), t.value.data() + t.value.size(), node->value);
+            position++;
+            return node;
+        }
+        if (t.type != TokenType::IDENTIFIER) return nullptr;
+        node->op = 'r';
+        node->names.push_back(symbols.Find(tokens[position++].value));
+        while (Is("::") && position + 1 < tokens.size()) {
+            position++;
+            node->names.push_back(symbols.Find(tokens[position++].value));
+        }
+        return node;
+    }
+
+    template<typename Resolve>
+    static std::optional<double> Evaluate(const Node& node, Resolve& resolve)
+    {
+        switch (node.op) {
+        case 'c': return node.value;
+        case 'r': {
+            Value value = resolve(std::span<const Symbol>(node.names));
+            if (value.type != ValueType::NUMBER) return std::nullopt;
+            return value.AsNumber();
+        }
+        case 'n': {
+            auto operand = Evaluate(*node.left, resolve);
+            return operand ? std::optional<double>(-*operand) : std::nullopt;
+        }
+        }
+        auto left = Evaluate(*node.left, resolve);
+        if (!left) return std::nullopt;
+        auto right = Evaluate(*node.right, resolve);
+        if (!right) return std::nullopt;
+        double result = node.op == '+' ? *left + *right : node.op == '-' ? *left - *right : node.op == '*' ? *left * *right : *left / *right;
+        if (!std::isfinite(result)) return std::nullopt;
+        return result;
+    }
+
+public:
+    TreeWalk(std::span<const Token> tokens, const SymbolTable& symbols) : tokens(tokens), symbols(symbols)
+    {
+        root = ParseSum();
+        if (position != tokens.size()) root.reset();
+    }
+
+    template<typename Resolve>
+    Value Evaluate(Resolve& resolve) const
+    {
+        if (!root) return Value();
+        // A lone reference keeps its type, as in Expression
+        if (root->op == 'r') return resolve(std::span<const Symbol>(root->names));
+        auto result = Evaluate(*root, resolve);
+        return result ? Value(*result) : Value();
+    }
+};
+
+// Deterministic random expressions over V0..V15 (V0 is 0, so some divisions fail), a string S and scoped C::V1
+class Generator
+{
+    uint64_t state = 88172645463325252ull;
+
+    uint32_t Next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<uint32_t>(state);
+    }
+
+public:
+    std::string Make(int depth)
+    {
+        if (depth == 0 || Next() % 4 == 0) {
+            switch (Next() % 8) {
+            case 0: case 1: case 2: return std::to_string(Next() % 100);
+            case 3: return std::to_string(Next() % 100) + ".5";
+            case 4: return "C::V1";
+            case 5: return Next() % 16 == 0 ? "S" : "V" + std::to_string(Next() % 16);
+            default: return "V" + std::to_string(Next() % 16);
+            }
+        }
+        switch (Next() % 6) {
+        case 0: return "-" + Make(depth - 1);
+        case 1: return "(" + Make(depth - 1) + ")";
+        default: {
+            const char* ops[] = { " + ", " - ", " * ", " / " };
+            return Make(depth - 1) + ops[Next() % 4] + Make(depth - 1);
+        }
+        }
+    }
+};
+
+static bool SameValue(const Value& a, const Value& b)
+{
+    if (a.type != b.type) return false;
+    return a.type != ValueType::NUMBER || a.AsNumber() == b.AsNumber();
+}
+
+static void CompareEvaluators(size_t count)
+{
+    SymbolTable symbols;
+    std::vector<Value> values(32);
+    for (int i = 0; i < 16; i++) values[symbols.Intern("V" + std::to_string(i))] = Value(i * 1.25);
+    values[symbols.Intern("S")] = Value("text");
+    symbols.Intern("C");
+    auto resolve = [&](std::span<const Symbol> names) {
+        Symbol name = names.back();
+        return name < values.size() ? values[name] : Value();
+    };
+
+    Generator generator;
+    std::string text;
+    for (size_t i = 0; i < count; i++) text += generator.Make(6) + "\n";
+    auto source = SourceBuffer::FromString(text);
+    std::vector<Token> tokens = Lexer::Get().ToTokens(*source);
+
+    std::vector<Expression> compiled;
+    std::vector<TreeWalk> walked;
+    size_t start = 0, failed = 0, voids = 0;
+    for (size_t i = 0; i <= tokens.size(); i++) {
+        if (i < tokens.size() && (i == start || tokens[i].line == tokens[start].line)) continue;
+        std::span<const Token> expression(tokens.data() + start, i - start);
+        start = i;
+        Expression& bytecode = compiled.emplace_back();
+        walked.emplace_back(expression, symbols);
+        // Folded to inf/nan: the tree walk has to find the same VOID
+        if (!Expression::Compile(expression, symbols, bytecode)) {
+            failed++;
+            bytecode = Expression();
+        }
+    }
+
+    for (size_t i = 0; i < compiled.size(); i++) {
+        Value a = compiled[i].Evaluate(resolve), b = walked[i].Evaluate(resolve);
+        if (a.type == ValueType::VOID) voids++;
+        if (!SameValue(a, b)) {
+            Bench::Check(false, "bytecode and tree walk differ");
+            break;
+        }
+    }
+
+    double sum = 0;
+    double bytecode_ms = Bench::Measure(5, [&] { for (auto& e : compiled) sum += e.Evaluate(resolve).AsNumber(); });
+    double walk_ms = Bench::Measure(5, [&] { for (auto& e : walked) sum += e.Evaluate(resolve).AsNumber(); });
+    std::printf("%zu expressions (%zu not compiled, %zu VOID)\n", compiled.size(), failed, voids);
+    std::printf("bytecode  %8.2f ms  %6.1f ns/expression\n", bytecode_ms, bytecode_ms * 1e6 / compiled.size());
+    std::printf("tree walk %8.2f ms  %6.1f ns/expression\n", walk_ms, walk_ms * 1e6 / compiled.size());
+    if (sum == 42) std::printf("\n");     // Keeps the loops
+}
+
+// Three derived constants per container, resolved through references to other containers
+static void LoadDerived(size_t count)
+{
+    std::string code = "tag::constants Base { K: 3; Scale: 0.5; }\n";
+    for (size_t i = 0; i < count; i++) {
+        std::string n = std::to_string(i);
+        code += "C" + n + " { A: Base::K * " + n + " + 1; B: (A - 1) / Base::K; F: -B * Base::Scale + 2 * (4 - 1); }\n";
+    }
+    std::shared_ptr<ContainersTree> tree;
+    double ms = Bench::Measure(3, [&] { tree = Loader::LoadFromString(code); });
+    for (size_t i : { size_t(0), count / 2, count - 1 }) {
+        std::string n = std::to_string(i);
+        Field* f = tree->GetField("C" + n + "::F");
+        Bench::Check(f && f->value.AsNumber() == -double(i) * 0.5 + 6, "derived constant");
+    }
+    std::printf("load of %zu derived constants (%.1f MB): %.1f ms\n", count * 3, code.size() / 1e6, ms);
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 50000;
+    CompareEvaluators(count);
+    LoadDerived(count);
+    return Bench::Result();
+}
@@ -0,0 +1,208 @@
+// Tokens/sec of the span lexer with every scanner level the CPU has, on a generated corpus, against the
+// classifier the lexer had before the character table (a std::string and a hash lookup per char and token).
+// The levels must produce the same tokens as the scalar loops, the old classifier the same values and types
+#include "BenchCommon.hpp"
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace DCL;
+
+// The lexer loop before the character table, kept as the baseline: every char is classified by
+// DetermineTokenType of a one-char std::string, operators by a set of std::string
+class LegacyLexer
+{
+    std::deque<std::string> materialized;
+    size_t token_start = std::string_view::npos;
+
+    static const std::unordered_set<std::string>& GetIsOperatorSet()
+    {
+        static std::unordered_set<std::string> set = { "+", "-", "*", "/", ":", "::" };
+        return set;
+    }
+
+    static const std::unordered_map<std::string, TokenType>& GetTokenTypeMap()
+    {
+        static std::unordered_map<std::string, TokenType> map = {
+            { "+", TokenType::OPERATOR }, { "-", TokenType::OPERATOR }, { "*", TokenType::OPERATOR },
+            { "/", TokenType::OPERATOR }, { ":", TokenType::OPERATOR }, { "::", TokenType::OPERATOR },
+            { ",", TokenType::DELIMITER }, { "{", TokenType::DELIMITER }, { "}", TokenType::DELIMITER },
+            { "[", TokenType::DELIMITER }, { "]", TokenType::DELIMITER }, { ";", TokenType::END },
+            { "tag", TokenType::KEYWORD }, { "copy", TokenType::KEYWORD }, { "key", TokenType::KEYWORD },
+        };
+        return map;
+    }
+
+    static bool IsNumber(const std::string& str)
+    {
+        if (str.empty()) return false;
+        size_t start = (str[0] == '-') ? 1 : 0;
+        if (start >= str.size()) return false;
+        bool has_dot = false;
+        for (size_t i = start; i < str.size(); i++) {
+            if (str[i] == '.') {
+                if (has_dot) return false;
+                has_dot = true;
+            }
+            else if (!std::isdigit(static_cast<unsigned char>(str[i]))) return false;
+        }
+        return true;
+    }
+
+    static TokenType DetermineTokenType(const std::string& value)
+    {
+        auto& map = GetTokenTypeMap();
+        if (auto it = map.find(value); it != map.end()) return it->second;
+        if (IsNumber(value)) return TokenType::NUMBER_LITERAL;
+        if (value == "true" || value == "false") return TokenType::BOOL_LITERAL;
+        return TokenType::IDENTIFIER;
+    }
+
+    static std::string GetOperator(const std::string& code)
+    {
+        if (code.empty()) return "";
+        std::string single_char(1, code[0]);
+        if (GetIsOperatorSet().count(single_char) == 0) return "";
+        if (code.size() > 1) {
+            std::string two_chars = single_char + code[1];
+            if (GetIsOperatorSet().count(two_chars) > 0) return two_chars;
+        }
+        return single_char;
+    }
+
+    static bool IsDelimiter(char c)
+    {
+        TokenType type = DetermineTokenType(std::string(1, c));
+        return (type & (TokenType::DELIMITER | TokenType::END)) != 0;
+    }
+
+    static Token CreateToken(std::string_view code, size_t offset, size_t length)
+    {
+        Token t;
+        t.value = code.substr(offset, length);
+        t.offset = offset;
+        t.type = DetermineTokenType(std::string(t.value));
+        return t;
+    }
+
+    void Flush(std::string_view code, size_t end, std::vector<Token>& tokens)
+    {
+        if (token_start == std::string_view::npos) return;
+        tokens.push_back(CreateToken(code, token_start, end - token_start));
+        token_start = std::string_view::npos;
+    }
+
+    Token StringLiteral(std::string_view code, size_t& i)
+    {
+        Token t;
+        t.offset = i;
+        t.type = TokenType::STRING_LITERAL;
+        std::string result;
+        for (; i < code.size() && code[i] != '"'; i++) {
+            if (code[i] == '\\' && i + 1 < code.size()) {
+                char next = code[++i];
+                result.push_back(next == 'n' ? '\n' : next == 't' ? '\t' : next);
+            }
+            else if (code[i] != '\r') result.push_back(code[i]);
+        }
+        if (result.size() == i - t.offset) t.value = code.substr(t.offset, result.size());
+        else {
+            materialized.push_back(std::move(result));
+            t.value = materialized.back();
+        }
+        return t;
+    }
+
+public:
+    std::vector<Token> ToTokens(std::string_view code)
+    {
+        materialized.clear();
+        std::vector<Token> tokens;
+        for (size_t i = 0; i < code.size(); i++) {
+            char c = code[i];
+            if (c == '\r') {
+                Flush(code, i, tokens);
+                continue;
+            }
+            if (c == '"' && token_start == std::string_view::npos) {
+                tokens.push_back(StringLiteral(code, ++i));
+                continue;
+            }
+            if (c == '/' && i + 1 < code.size() && code[i + 1] == '/') {
+                Flush(code, i, tokens);
+                while (i < code.size() && code[i] != '\n') i++;
+                continue;
+            }
+            if (IsDelimiter(c)) {
+                Flush(code, i, tokens);
+                tokens.push_back(CreateToken(code, i, 1));
+                continue;
+            }
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                Flush(code, i, tokens);
+                continue;
+            }
+            if (std::string oper = GetOperator(std::string(code.substr(i, 2))); oper != "") {
+                Flush(code, i, tokens);
+                tokens.push_back(CreateToken(code, i, oper.size()));
+                i += oper.size() - 1;
+                continue;
+            }
+            if (token_start == std::string_view::npos) token_start = i;
+        }
+        Flush(code, code.size(), tokens);
+        return tokens;
+    }
+};
+
+static bool SameTokens(const std::vector<Token>& left, const std::vector<Token>& right)
+{
+    if (left.size() != right.size()) return false;
+    for (size_t i = 0; i < left.size(); i++) {
+        const Token& a = left[i];
+        const Token& b = right[i];
+        if (a.value != b.value || a.type != b.type || a.line != b.line || a.column != b.column || a.offset != b.offset) return false;
+    }
+    return true;
+}
+
+static bool SameValues(const std::vector<Token>& left, const std::vector<Token>& right)
+{
+    if (left.size() != right.size()) return false;
+    for (size_t i = 0; i < left.size(); i++) {
+        if (left[i].value != right[i].value || left[i].type != right[i].type) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t entities = argc > 1 ? std::stoul(argv[1]) : 50000;
+    auto source = SourceBuffer::FromString(Bench::GenerateEntities(entities));
+    size_t bytes = source->Text().size();
+    std::printf("corpus: %zu entities, %.1f MB\n", entities, bytes / 1e6);
+
+    const std::pair<Scanner::Level, const char*> levels[] = {
+        { Scanner::Level::SCALAR, "scalar" }, { Scanner::Level::SSE2, "sse2" }, { Scanner::Level::AVX2, "avx2" } };
+
+    Scanner::SetLevel(Scanner::Level::SCALAR);
+    std::vector<Token> reference = Lexer::Get().ToTokens(*source);
+
+    LegacyLexer legacy;
+    std::vector<Token> legacy_tokens = legacy.ToTokens(source->Text());
+    Bench::Check(SameValues(legacy_tokens, reference), "old classifier");
+    double legacy_ms = Bench::Measure(5, [&] { legacy_tokens = legacy.ToTokens(source->Text()); });
+    std::printf("%-7s %8.1f ms %8.1f Mtokens/s %8.1f MB/s\n", "before", legacy_ms, legacy_tokens.size() / legacy_ms / 1e3, bytes / legacy_ms / 1e3);
+
+    for (auto [level, name] : levels) {
+        if (!Scanner::SetLevel(level)) {
+            std::printf("%-7s not supported\n", name);
+            continue;
+        }
+        std::vector<Token> tokens = Lexer::Get().ToTokens(*source);
+        Bench::Check(SameTokens(tokens, reference), name);
+
+        double ms = Bench::Measure(5, [&] { tokens = Lexer::Get().ToTokens(*source); });
+        std::printf("%-7s %8.1f ms %8.1f Mtokens/s %8.1f MB/s\n", name, ms, tokens.size() / ms / 1e3, bytes / ms / 1e3);
+    }
+    return Bench::Result();
+}
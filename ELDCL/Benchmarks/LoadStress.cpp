@@ -0,0 +1,111 @@
+// Stress test of concurrent loading, meant to run under ThreadSanitizer:
+//   g++ -std=c++20 -O1 -g -pthread -fsanitize=thread Benchmarks/LoadStress.cpp -o load_stress
+// A directory of generated files with references across them is loaded by several threads at once through
+// LoadDirectory / LoadMany (every mode), while others load single files. All of them share ThreadPool::Get()
+#include "BenchCommon.hpp"
+#include <fstream>
+#include <thread>
+
+using namespace DCL;
+
+static std::string PartName(size_t i) { return "Part" + std::to_string(i); }
+
+// File i refers to the previous one and copies the shared constants of file 0
+static void WriteFiles(const std::filesystem::path& directory, size_t count)
+{
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory / "nested");
+    for (size_t i = 0; i < count; i++) {
+        std::string n = std::to_string(i);
+        std::string code;
+        if (i == 0) code += "tag::constants Shared { K: 7; S: \"shared\"; }\n";
+        code += "tag::part " + PartName(i) + "\n{\n";
+        code += "\tkey Name = \"part" + n + "\";\n";
+        code += "\tID: " + n + ";\n";
+        code += "\tPrev: " + (i == 0 ? std::string("-1") : PartName(i - 1) + "::ID") + ";\n";
+        code += "\tcopy Shared;\n";
+        code += "\tDerived: Shared::K * " + n + " + 1;\n";
+        for (size_t child = 0; child < 20; child++) {
+            code += "\ttag::component C" + std::to_string(child) + " { Value: " + std::to_string(child) + "; List: [1, 2, \"three\"]; }\n";
+        }
+        code += "}\n";
+        // Every fourth file lives in a subdirectory
+        char filename[32];
+        std::snprintf(filename, sizeof(filename), "part%04zu.dcl", i);
+        std::ofstream(directory / (i % 4 == 0 ? "nested" : ".") / filename) << code;
+    }
+}
+
+static void CheckCatalog(const Catalog& catalog, size_t count)
+{
+    Bench::Check(catalog.tree != nullptr && catalog.files.size() == count, "catalog size");
+    if (!catalog.tree) return;
+    for (const FileLoadStats& stats : catalog.files) Bench::Check(stats.loaded, "file loaded");
+
+    auto& tree = *catalog.tree;
+    for (size_t i = 0; i < count; i++) {
+        std::string name = PartName(i);
+        Field* id = tree.GetField(name + "::ID");
+        Field* prev = tree.GetField(name + "::Prev");
+        Field* derived = tree.GetField(name + "::Derived");
+        Field* copied = tree.GetField(name + "::S");
+        Bench::Check(id && id->value.AsNumber() == double(i), "ID");
+        Bench::Check(prev && prev->value.AsNumber() == double(i) - 1, "reference across files");
+        Bench::Check(derived && derived->value.AsNumber() == 7.0 * i + 1, "expression across files");
+        Bench::Check(copied && copied->value.AsString() == "shared", "copy across files");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 300;
+    int rounds = argc > 2 ? std::stoi(argv[2]) : 3;
+    size_t threads = argc > 3 ? std::stoul(argv[3]) : 6;
+
+    auto directory = std::filesystem::temp_directory_path() / "eldcl_load_stress";
+    WriteFiles(directory, count);
+
+    std::vector<std::string> paths;
+    for (auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
+        if (entry.is_regular_file()) paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::mutex check_mutex;     // Check counts failures in a plain int
+    auto start = Bench::Clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            for (int round = 0; round < rounds; round++) {
+                LoadOptions options;
+                options.arena_mode = (t + round) & 1;
+                options.lazy_mode = (t + round) & 2;
+                options.parallel_mode = t % 3 == 0;
+                if (t % 4 == 3) {
+                    // Single files next to the catalogs: the references to other files stay VOID
+                    for (size_t i = 0; i < paths.size(); i += 7) {
+                        auto tree = Loader::LoadFromFile(paths[i], options);
+                        std::lock_guard lock(check_mutex);
+                        Bench::Check(tree != nullptr, "single file");
+                    }
+                    continue;
+                }
+                Catalog catalog = t % 2 == 0 ? Loader::LoadDirectory(directory.string(), ".dcl", options) : Loader::LoadMany(paths, options);
+                // Lazy values are parsed by the readers, several threads read one tree
+                std::thread second_reader([&]() {
+                    if (catalog.tree) catalog.tree->GetField(PartName(count / 2) + "::Derived");
+                    });
+                {
+                    std::lock_guard lock(check_mutex);
+                    CheckCatalog(catalog, count);
+                }
+                second_reader.join();
+            }
+            });
+    }
+    for (auto& worker : workers) worker.join();
+    std::printf("%zu threads x %d rounds over %zu files: %.1f ms\n", threads, rounds, count, Bench::MillisecondsSince(start));
+
+    std::filesystem::remove_all(directory);
+    return Bench::Result();
+}
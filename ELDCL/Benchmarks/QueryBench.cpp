@@ -0,0 +1,89 @@
+// Query pipeline against the same traversal written by hand: "all component containers under entity whose
+// ID > limit, with their Origin", without and with a field index. Both must find the same rows
+#include "BenchCommon.hpp"
+
+using namespace DCL;
+
+struct ManualRow
+{
+    std::shared_ptr<Container> container;
+    Field* origin;
+};
+
+// Breadth-first like the tag index, so the rows come in the same order
+static std::vector<ManualRow> ManualWalk(ContainersTree& tree, double limit)
+{
+    const SymbolTable& symbols = tree.GetSymbols();
+    Symbol entity = symbols.Find("entity"), component = symbols.Find("component");
+    Symbol id = symbols.Find("ID"), origin = symbols.Find("Origin");
+
+    std::vector<ManualRow> rows;
+    std::vector<std::shared_ptr<Container>> queue = { tree.GetRoot() };
+    for (size_t i = 0; i < queue.size(); i++) {
+        for (auto& field : queue[i]->ordered_fields) {
+            if (field.isContainer && field.container) queue.push_back(field.container);
+        }
+    }
+    for (auto& container : queue) {
+        if (container->tag != entity) continue;
+        Field* field = container->FindField(id, false);
+        if (!field || field->value.type != ValueType::NUMBER || !(field->value.AsNumber() > limit)) continue;
+        for (auto& child : container->ordered_fields) {
+            if (child.isContainer && child.container && child.container->tag == component) {
+                rows.push_back({ child.container, child.container->FindField(origin) });
+            }
+        }
+    }
+    return rows;
+}
+
+// The chain is a temporary, as in the example of Query.hpp: the range-for has to keep it alive
+static std::vector<ManualRow> QueryRows(std::shared_ptr<ContainersTree> tree, double limit)
+{
+    std::vector<ManualRow> rows;
+    for (const auto& row : Query(tree).Tag("entity").Where("ID", Query::GREATER, limit).Children("component").Select({ "Origin" })) {
+        rows.push_back({ row.container, row.fields[0] });
+    }
+    return rows;
+}
+
+static bool SameRows(std::vector<ManualRow> left, std::vector<ManualRow> right, bool ordered)
+{
+    auto by_address = [](const ManualRow& a, const ManualRow& b) { return a.container < b.container; };
+    if (!ordered) {
+        std::sort(left.begin(), left.end(), by_address);
+        std::sort(right.begin(), right.end(), by_address);
+    }
+    if (left.size() != right.size()) return false;
+    for (size_t i = 0; i < left.size(); i++) {
+        if (left[i].container != right[i].container || left[i].origin != right[i].origin) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t entities = argc > 1 ? std::stoul(argv[1]) : 50000;
+    auto tree = Loader::LoadFromString(Bench::GenerateEntities(entities));
+    double limit = entities / 2.0;
+    std::printf("tree: %zu entities, ID > %.0f\n", entities, limit);
+
+    // An iterator taken from a temporary outlives it too
+    auto first = Query(tree).Tag("entity").begin();
+    Bench::Check(first != Query::Iterator() && first->container->GetTag() == "entity", "iterator of a temporary query");
+
+    std::vector<ManualRow> manual = ManualWalk(*tree, limit);
+    Bench::Check(!manual.empty() && SameRows(QueryRows(tree, limit), manual, true), "query rows");
+    double manual_ms = Bench::Measure(5, [&] { manual = ManualWalk(*tree, limit); });
+    double query_ms = Bench::Measure(5, [&] { QueryRows(tree, limit); });
+
+    // Indexed ID: the entities come from the index, ascending by ID
+    tree->CreateIndex("ID", true);
+    Bench::Check(SameRows(QueryRows(tree, limit), manual, false), "indexed query rows");
+    double indexed_ms = Bench::Measure(5, [&] { QueryRows(tree, limit); });
+
+    std::printf("manual  %8.2f ms  %zu rows\n", manual_ms, manual.size());
+    std::printf("query   %8.2f ms\n", query_ms);
+    std::printf("indexed %8.2f ms\n", indexed_ms);
+    return Bench::Result();
+}
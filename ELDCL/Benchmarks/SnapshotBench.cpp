@@ -0,0 +1,119 @@
+// Contention of many reader threads with one thread publishing a new tree periodically: SnapshotHandle
+// against a std::shared_mutex around the tree, then SnapshotHandle with the trees of a HotReloader in snapshot
+// mode. Every read must see one whole snapshot. Meant to be run under ThreadSanitizer too:
+//   g++ -std=c++20 -O1 -g -pthread -fsanitize=thread Benchmarks/SnapshotBench.cpp -o snapshot_bench
+#include "BenchCommon.hpp"
+#include <shared_mutex>
+#include <thread>
+
+using namespace DCL;
+
+// V and W = 2 * V of one snapshot, a reader seeing a mix of two trees would find W != 2 * V
+static std::string MakeCode(int version)
+{
+    return "tag::config Config { V: " + std::to_string(version) + "; W: V * 2; }\n" + Bench::GenerateEntities(200);
+}
+
+static std::shared_ptr<ContainersTree> MakeTree(int version)
+{
+    return Loader::LoadFromString(MakeCode(version));
+}
+
+static bool Consistent(ContainersTree& tree)
+{
+    Field* v = tree.GetField("Config::V");
+    Field* w = tree.GetField("Config::W");
+    Field* entity = tree.GetField("Entity100::Transform::Scale");
+    return v && w && entity && w->value.AsNumber() == v->value.AsNumber() * 2;
+}
+
+struct Result
+{
+    double reads_per_ms = 0;
+    int publishes = 0;
+    double max_publish_ms = 0;
+};
+
+// read(): one lookup of the current tree, make(version): the next tree, publish(tree): replaces it.
+// Readers stop at the deadline on their own: a publisher starved by a lock gets through after it
+template<typename Read, typename Make, typename Publish>
+static Result Run(size_t readers, int duration_ms, int period_ms, Read&& read, Make&& make, Publish&& publish)
+{
+    auto deadline = Bench::Clock::now() + std::chrono::milliseconds(duration_ms);
+    std::atomic<uint64_t> reads = 0;
+    std::atomic<int> torn = 0;
+    std::vector<std::thread> threads;
+    for (size_t r = 0; r < readers; r++) {
+        threads.emplace_back([&]() {
+            uint64_t count = 0;
+            while ((count & 63) != 0 || Bench::Clock::now() < deadline) {
+                if (!read()) torn.fetch_add(1, std::memory_order_relaxed);
+                count++;
+            }
+            reads.fetch_add(count);
+            });
+    }
+
+    Result result;
+    for (int version = 1; Bench::Clock::now() < deadline; version++) {
+        auto tree = make(version);          // Decoded outside of any lock, as a reload thread would
+        auto publish_start = Bench::Clock::now();
+        publish(std::move(tree));
+        result.max_publish_ms = std::max(result.max_publish_ms, Bench::MillisecondsSince(publish_start));
+        result.publishes++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(period_ms));
+    }
+    for (auto& thread : threads) thread.join();
+
+    Bench::Check(torn == 0, "a reader saw a torn snapshot");
+    result.reads_per_ms = double(reads) / duration_ms;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    size_t max_readers = argc > 1 ? std::stoul(argv[1]) : 8;
+    int duration_ms = argc > 2 ? std::stoi(argv[2]) : 1000;
+    int period_ms = argc > 3 ? std::stoi(argv[3]) : 5;
+    std::printf("readers, %d ms per run, a new tree every %d ms, %u hardware threads\n", duration_ms, period_ms, std::thread::hardware_concurrency());
+
+    for (size_t readers = 1; readers <= max_readers; readers *= 2) {
+        SnapshotHandle handle(MakeTree(0));
+        Result rcu = Run(readers, duration_ms, period_ms,
+            [&]() {
+                auto snapshot = handle.Read();
+                return Consistent(*snapshot);
+            },
+            MakeTree, [&](std::shared_ptr<ContainersTree> tree) { handle.Publish(std::move(tree)); });
+
+        std::shared_mutex mutex;
+        std::shared_ptr<ContainersTree> current = MakeTree(0);
+        Result locked = Run(readers, duration_ms, period_ms,
+            [&]() {
+                std::shared_lock lock(mutex);
+                return Consistent(*current);
+            },
+            MakeTree, [&](std::shared_ptr<ContainersTree> tree) {
+                std::unique_lock lock(mutex);
+                current.swap(tree);
+            });     // The old tree is destroyed after the lock is released
+
+        std::printf("%2zu  snapshot: %8.0f reads/ms %4d publishes (max %.2f ms) | shared_mutex: %8.0f reads/ms %4d publishes (max %.2f ms)\n",
+            readers, rcu.reads_per_ms, rcu.publishes, rcu.max_publish_ms, locked.reads_per_ms, locked.publishes, locked.max_publish_ms);
+    }
+
+    // A reloaded tree is published, never patched while readers have it
+    HotReloader reloader;
+    reloader.SetSnapshotMode(true);
+    SnapshotHandle handle(reloader.Load(MakeCode(0)));
+    Result reloaded = Run(max_readers, duration_ms, period_ms,
+        [&]() {
+            auto snapshot = handle.Read();
+            return Consistent(*snapshot);
+        },
+        [&](int version) { return reloader.Reload(MakeCode(version)).tree; },
+        [&](std::shared_ptr<ContainersTree> tree) { handle.Publish(std::move(tree)); });
+    Bench::Check(handle.Read()->GetField("Config::V")->value.AsNumber() == reloaded.publishes, "last reloaded tree");
+    std::printf("%2zu  reloads:  %8.0f reads/ms %4d publishes (max %.2f ms)\n", max_readers, reloaded.reads_per_ms, reloaded.publishes, reloaded.max_publish_ms);
+    return Bench::Result();
+}
@@ -1,4 +1,10 @@
 #pragma once
 #include "Loading\Loader.hpp"
+#include "Loading\StreamLoader.hpp"
+#include "Loading\HotReloader.hpp"
+#include "Decoding\SaxParser.hpp"
+#include "Decoding\FrozenTree.hpp"
+#include "Decoding\Query.hpp"
+#include "Decoding\SnapshotHandle.hpp"
 #include "Serialization\Serializator.hpp"
 #include "Tokenization/Lexer.hpp"
\ No newline at end of file
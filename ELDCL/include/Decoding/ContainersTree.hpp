@@ -1,105 +1,335 @@
 ﻿#pragma once
 #include "..\Tokenization\TokensInfo.hpp"
+#include "..\Tokenization\SourceBuffer.hpp"
+#include "..\Definitions\TreeStorage.hpp"
 #include "..\Definitions\StringOperations.hpp"
+#include "TreeIndex.hpp"
 
 namespace DCL 
 {
+    class ContainersTree;
+
+    // Path compiled by ContainersTree::Compile: names are interned once, the resolved field is cached
+    // and reused until the generation of the tree changes. Not thread-safe: one handle per thread.
+    // The tree doesn't see edits made through GetRoot(): call NotifyChanged after them, or handles keep the old field
+    class PathHandle
+    {
+        friend class ContainersTree;
+
+        std::vector<std::string> names;
+        std::vector<Symbol> parts;          // NO_SYMBOL for names the tree didn't have yet
+        uint64_t tree = 0;                  // Id of the tree the parts are symbols of
+        Container* owner = nullptr;         // Container of the field, nullptr if the path didn't resolve
+        size_t slot = 0;
+        uint64_t generation = 0;            // Of the tree when resolved, 0 if never (generations start at 1)
+
+    public:
+        const std::vector<std::string>& GetNames() const { return names; }
+    };
+
 	class ContainersTree 
 	{
-		std::vector<Field> global_fields;
+        // Names of all fields, containers and tags. Declared first: the root is made with it
+        std::shared_ptr<SymbolTable> symbols;
+
+        // Top-level fields live in the root container to share its field index
+		std::shared_ptr<Container> root;
 
         // "Индексы" как в БД - быстрый поиск по key-полям
         std::unordered_map<std::string, std::shared_ptr<Container>> key_index;
 
+        // Arena with the containers in arena mode, nullptr otherwise
+        std::shared_ptr<TreeStorage> storage;
+
+        // Id and generations come from one counter of the process: a tree made at the address of a freed one
+        // doesn't look like it to a handle
+        const uint64_t id = NextStamp();
+
+        // Changed by NotifyChanged, compiled paths compare it to their cache
+        std::atomic<uint64_t> generation = NextStamp();
+
+        // Tag and field indexes of the current generation, replaced as a whole when they're out of date
+        mutable std::mutex index_mutex;
+        mutable std::shared_ptr<const TreeIndex> index;
+        std::vector<TreeIndex::Definition> index_definitions;
+
+        // Texts the tokens of the tree point into: one per file the tree was loaded from
+        std::vector<std::shared_ptr<SourceBuffer>> sources;
+
+        // Parser of the values not parsed yet (lazy mode), nullptr otherwise
+        std::shared_ptr<LazyResolver> lazy_resolver;
+
+        static uint64_t NextStamp()
+        {
+            static std::atomic<uint64_t> last = 0;
+            return last.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        static std::shared_ptr<Container> MakeRoot(std::pmr::vector<Field>& fields, SymbolTable* symbols)
+        {
+            auto container = std::make_shared<Container>();
+            container->name = SymbolTable::ROOT;
+            container->symbols = symbols;
+            container->ordered_fields = fields;
+            container->RebuildIndex();
+            return container;
+        }
+
 	public:
-        ContainersTree(std::vector<Field>& fields) : global_fields(fields) {}
-        ContainersTree(std::vector<Field>& fields, std::unordered_map<std::string, std::shared_ptr<Container>>& key_index) : global_fields(fields), key_index(key_index) {}
+        ContainersTree(std::pmr::vector<Field>& fields, std::shared_ptr<SymbolTable> symbols) : symbols(symbols), root(MakeRoot(fields, symbols.get())) {}
+        ContainersTree(std::shared_ptr<Container> root, std::unordered_map<std::string, std::shared_ptr<Container>>& key_index, 
+            std::shared_ptr<SymbolTable> symbols, std::shared_ptr<SourceBuffer> source = nullptr, std::shared_ptr<TreeStorage> storage = nullptr) 
+            : symbols(std::move(symbols)), root(std::move(root)), key_index(key_index), storage(std::move(storage))
+        {
+            if (source) sources.push_back(std::move(source));
+            GetIndex();     // The tag index comes with the tree
+        }
+
+        ~ContainersTree()
+        {
+            // Handles into the arena must go before the arena itself
+            root.reset();
+            key_index.clear();
+            index.reset();
+            storage.reset();
+        }
+
+    private:
+        // Symbols of "A::B::C" (an ending "::" is ignored, as SplitString does)
+        void SplitPath(std::string_view path, std::vector<Symbol>& parts) const
+        {
+            parts.clear();
+            size_t start = 0;
+            while (start < path.size()) {
+                size_t end = path.find("::", start);
+                if (end == std::string_view::npos) end = path.size();
+                parts.push_back(symbols->Find(path.substr(start, end - start)));
+                start = end + 2;
+            }
+        }
+
+        // Containers up to the last part, then the field: a value field, or the container itself for a one-part path
+        Field* ResolvePath(std::span<const Symbol> parts, Container*& owner) const
+        {
+            owner = nullptr;
+            if (parts.empty()) return nullptr;
 
+            // Ищем стартовый контейнер в глобальных полях
+            Container* current_owner = root.get();
+            Field* current_field = root->FindField(parts[0], true);
+            if (!current_field || !current_field->container) return nullptr;
+
+            // Идём по цепочке контейнеров
+            for (size_t i = 1; i < parts.size(); i++) {
+                bool last = i + 1 == parts.size();
+                current_owner = current_field->container.get();
+                current_field = current_owner->FindField(parts[i], !last);
+                if (!current_field || (!last && !current_field->container)) return nullptr;
+            }
+            owner = current_owner;
+            return current_field;
+        }
+
+    public:
 		//KEY::A::B
         // Поиск поля по абсолютному пути "Container::Field"
         Field* GetField(const std::string& absolute_path) {
-            auto path_parts = StringOperations::SplitString(absolute_path, "::");
-            if (path_parts.empty()) return nullptr;
+            static thread_local std::vector<Symbol> parts;     // Reused, so a lookup doesn't allocate
+            SplitPath(absolute_path, parts);
+            Container* owner;
+            return ResolvePath(parts, owner);
+        }
 
-            // Ищем стартовый контейнер в глобальных полях
-            Field* current_field = nullptr;
-            for (Field& field : global_fields) {
-                if (field.name == path_parts[0] && field.isContainer) {
-                    current_field = &field;
-                    break;
+        // For paths looked up again and again: see PathHandle
+        PathHandle Compile(const std::string& absolute_path) const
+        {
+            PathHandle handle;
+            SplitPath(absolute_path, handle.parts);
+            for (const auto& part : StringOperations::SplitString(absolute_path, "::")) handle.names.push_back(part);
+            handle.names.resize(handle.parts.size());
+            handle.tree = id;
+            return handle;
+        }
+
+        // While the tree is unchanged this is a generation compare and an index into the cached container
+        Field* GetField(PathHandle& handle)
+        {
+            uint64_t current = generation.load(std::memory_order_acquire);
+            if (handle.generation == current && handle.tree == id) {
+                if (!handle.owner) return nullptr;
+                auto& fields = handle.owner->ordered_fields;
+                if (handle.slot < fields.size() && fields[handle.slot].name == handle.parts.back()) {
+                    fields[handle.slot].EnsureValue();
+                    return &fields[handle.slot];
                 }
             }
 
-            if (!current_field || !current_field->container) {
-                return nullptr; // Контейнер не найден
+            if (handle.tree != id || handle.generation != current) {
+                // Names unknown before may have appeared since
+                for (size_t i = 0; i < handle.parts.size(); i++) {
+                    if (handle.tree != id || handle.parts[i] == SymbolTable::NO_SYMBOL) handle.parts[i] = symbols->Find(handle.names[i]);
+                }
+                handle.tree = id;
             }
+            Field* field = ResolvePath(handle.parts, handle.owner);
+            if (field) handle.slot = field - handle.owner->ordered_fields.data();
+            else handle.owner = nullptr;
+            handle.generation = current;
+            return field;
+        }
 
-            // Идём по цепочке контейнеров
-            auto current_container = current_field;
-            for (size_t i = 1; i < path_parts.size(); i++) {
-                if (i == path_parts.size() - 1) {
-                    // Последняя часть - ищем поле
-                    for (auto& field : current_container->container->ordered_fields) {
-                        if (field.name == path_parts[i] && !field.isContainer) {
-                            return &field;
-                        }
-                    }
+        // Call after adding or removing fields and containers of the tree (edits through GetRoot() aren't seen
+        // otherwise): compiled paths resolve again and the indexes are rebuilt
+        void NotifyChanged()
+        {
+            generation.store(NextStamp(), std::memory_order_release);
+        }
+
+        // Key index after containers were replaced in place (see HotReloader): keys of removed containers and of
+        // everything under them are dropped, then added ones are indexed, replacing what they clash with
+        void UpdateKeys(const std::vector<std::shared_ptr<Container>>& removed,
+            const std::unordered_map<std::string, std::shared_ptr<Container>>& added)
+        {
+            std::vector<Container*> queue;
+            for (const auto& container : removed) queue.push_back(container.get());
+            for (size_t i = 0; i < queue.size(); i++) {
+                Container* container = queue[i];
+                if (container->key) {
+                    auto it = key_index.find(container->key->value.ToString());
+                    if (it != key_index.end() && it->second.get() == container) key_index.erase(it);
                 }
-                else {
-                    // Промежуточная часть - ищем контейнер
-                    bool found = false;
-                    for (auto& field : current_container->container->ordered_fields) {
-                        if (field.name == path_parts[i] && field.isContainer && field.container) {
-                            current_container = &field;
-                            found = true;
-                            break;
-                        }
-                    }
-                    if (!found) return nullptr;
+                for (auto& f : container->ordered_fields) {
+                    if (f.isContainer && f.container) queue.push_back(f.container.get());
                 }
             }
-            return current_container;
+            for (const auto& [key, container] : added) key_index[key] = container;
+            NotifyChanged();
+        }
+
+        uint64_t GetGeneration() const
+        {
+            return generation.load(std::memory_order_acquire);
         }
 
+        // Current indexes, rebuilt here if the tree has changed since. Safe to call from several threads
+        std::shared_ptr<const TreeIndex> GetIndex() const
+        {
+            std::lock_guard lock(index_mutex);
+            uint64_t current = generation.load(std::memory_order_acquire);
+            if (!index || index->GetGeneration() != current) index = TreeIndex::Build(root, index_definitions, current);
+            return index;
+        }
 
+        // Containers with the tag among the fields of where (the root by default);
+        // deep adds their descendants with the same tag, breadth-first
         std::vector<std::shared_ptr<Container>> GetByTag(const std::string& tag_value, std::shared_ptr<Container> where = nullptr, bool deep = false)const
         {
             std::vector<std::shared_ptr<Container>> containers;
-            std::queue<std::shared_ptr<Container>> deep_containers;
-            std::unordered_set<std::shared_ptr<Container>> visited; // Защита от циклов
+            Symbol tag = symbols->Find(tag_value);
+            if (tag == SymbolTable::NO_SYMBOL) return containers;
+            if (!where) where = root;
 
-            const std::vector<Field>& fields = (where != nullptr) ? where->ordered_fields : global_fields;
+            if (where == root) {
+                // The index is breadth-first as well: keep the ones whose chain of same-tag parents leads to where
+                for (const auto& container : GetIndex()->ByTag(tag)) {
+                    Container* parent = container->parent;
+                    while (deep && parent && parent != where.get() && parent->tag == tag) parent = parent->parent;
+                    if (parent == where.get()) containers.push_back(container);
+                }
+                return containers;
+            }
 
             // Начальные контейнеры
-            for (auto& f : fields) {
-                if (f.isContainer && f.container && f.container->tag == tag_value) {
-                    if (visited.insert(f.container).second) { // Проверяем, не посещали ли уже
-                        deep_containers.push(f.container);
-                    }
+            for (auto& f : where->ordered_fields) {
+                if (f.isContainer && f.container && f.container->tag == tag) containers.push_back(f.container);
+            }
+            // BFS обход, the result itself is the queue
+            for (size_t i = 0; deep && i < containers.size(); i++) {
+                for (auto& f : containers[i]->ordered_fields) {
+                    if (f.isContainer && f.container && f.container->tag == tag) containers.push_back(f.container);
                 }
             }
+            return containers;
+        }
 
-            // BFS обход
-            while (!deep_containers.empty()) {
-                auto container = deep_containers.front();
-                deep_containers.pop();
-
-                containers.push_back(container);
-
-                if (deep) {
-                    for (auto& f : container->ordered_fields) {
-                        if (f.isContainer && f.container && f.container->tag == tag_value) {
-                            if (visited.insert(f.container).second) { // Избегаем повторов
-                                deep_containers.push(f.container);
-                            }
-                        }
-                    }
+        // Index on the field of every container: FindBy answers from a hash table,
+        // ordered indexes also answer FindRange on numbers. Declared indexes survive changes of the tree
+        void CreateIndex(const std::string& field_name, bool ordered = false)
+        {
+            Symbol field = symbols->Intern(field_name);
+            {
+                std::lock_guard lock(index_mutex);
+                bool found = false;
+                for (auto& definition : index_definitions) {
+                    if (definition.field != field) continue;
+                    definition.ordered = definition.ordered || ordered;
+                    found = true;
                 }
+                if (!found) index_definitions.push_back({ field, ordered });
+                index.reset();
+            }
+            GetIndex();
+        }
+
+        // Containers whose field equals value (compared as Value::ToString), breadth-first
+        std::vector<std::shared_ptr<Container>> FindBy(const std::string& field_name, const Value& value) const
+        {
+            Symbol field = symbols->Find(field_name);
+            if (field == SymbolTable::NO_SYMBOL) return {};
+            std::string wanted = value.ToString();
+
+            auto current = GetIndex();
+            if (const auto* field_index = current->FindIndex(field)) {
+                auto it = field_index->by_value.find(wanted);
+                return it != field_index->by_value.end() ? it->second : std::vector<std::shared_ptr<Container>>();
             }
 
+            // No index: look at every container
+            std::vector<std::shared_ptr<Container>> containers;
+            ForEachContainer([&](const std::shared_ptr<Container>& container) {
+                Field* f = container->FindField(field, false);
+                if (f && f->value.type != ValueType::VOID && f->value.ToString() == wanted) containers.push_back(container);
+                });
+            return containers;
+        }
+
+        // Containers whose numeric field is in [min, max], ascending (breadth-first without an ordered index)
+        std::vector<std::shared_ptr<Container>> FindRange(const std::string& field_name, double min, double max) const
+        {
+            std::vector<std::shared_ptr<Container>> containers;
+            Symbol field = symbols->Find(field_name);
+            if (field == SymbolTable::NO_SYMBOL) return containers;
+
+            auto current = GetIndex();
+            if (const auto* field_index = current->FindIndex(field, true)) {
+                const auto& numbers = field_index->by_number;
+                auto it = std::lower_bound(numbers.begin(), numbers.end(), min, [](const auto& entry, double value) { return entry.first < value; });
+                for (; it != numbers.end() && it->first <= max; ++it) containers.push_back(it->second);
+                return containers;
+            }
+
+            ForEachContainer([&](const std::shared_ptr<Container>& container) {
+                Field* f = container->FindField(field, false);
+                if (f && f->value.type == ValueType::NUMBER && f->value.AsNumber() >= min && f->value.AsNumber() <= max)
+                    containers.push_back(container);
+                });
             return containers;
         }
 
+        // Every container of the tree except the root, breadth-first
+        template<typename Function>
+        void ForEachContainer(Function&& function) const
+        {
+            std::vector<Container*> queue = { root.get() };
+            for (size_t i = 0; i < queue.size(); i++) {
+                for (auto& f : queue[i]->ordered_fields) {
+                    if (!f.isContainer || !f.container) continue;
+                    function(f.container);
+                    queue.push_back(f.container.get());
+                }
+            }
+        }
+
 
         // Быстрый поиск по key (аналог SELECT * FROM containers WHERE key = 'player_1')
         std::shared_ptr<Container> FindByKey(const std::string& key_value) const {
@@ -111,7 +341,7 @@ namespace DCL
 		{
 			if (field.isContainer) 
 			{
-				std::cout << "Container (" << field.container->tag + "): " << field.name << "{\n";
+				std::cout << "Container (" << field.container->GetTag() << "): " << symbols->Name(field.name) << "{\n";
 
 				for (auto& f : field.container->ordered_fields)
 				{
@@ -121,23 +351,69 @@ namespace DCL
 				return;
 			}
 
-			std::cout << "Field: " << field.name << " |" << (field.isKey ? "key" : "not a key") << "| " << field.value.ToString() << "\n";
+			field.EnsureValue();
+			std::cout << "Field: " << symbols->Name(field.name) << " |" << (field.isKey ? "key" : "not a key") << "| " << field.value.ToString() << "\n";
 		}
 
 		void PrintFields() {
 
-			for (auto& f : global_fields) 
+			for (auto& f : root->ordered_fields) 
 			{
 				PrintField(f);
 			}
 		}
 
 
-        std::vector<Field>& GetGlobalFields() 
+        // Lazy values among them aren't parsed: see EnsureValues
+        std::pmr::vector<Field>& GetGlobalFields() 
         {
-            return global_fields;
+            return root->ordered_fields;
         }
 
+        // Fields and containers changed through it need NotifyChanged afterwards
+        std::shared_ptr<Container> GetRoot() const
+        {
+            return root;
+        }
+
+        const std::unordered_map<std::string, std::shared_ptr<Container>>& GetKeyIndex() const
+        {
+            return key_index;
+        }
+
+        SymbolTable& GetSymbols() const
+        {
+            return *symbols;
+        }
+
+        // Source of a tree loaded from one text, the first one of a catalog
+        std::shared_ptr<SourceBuffer> GetSource() const
+        {
+            return sources.empty() ? nullptr : sources.front();
+        }
+
+        const std::vector<std::shared_ptr<SourceBuffer>>& GetSources() const
+        {
+            return sources;
+        }
+
+        void RetainSource(std::shared_ptr<SourceBuffer> source)
+        {
+            if (source) sources.push_back(std::move(source));
+        }
+
+        // For a tree patched in place (see HotReloader): the texts it still points into, the others are released
+        void ReplaceSources(std::vector<std::shared_ptr<SourceBuffer>> kept)
+        {
+            sources = std::move(kept);
+        }
+
+        // Lazy values of the tree point to the resolver
+        void RetainLazyResolver(std::shared_ptr<LazyResolver> resolver) { lazy_resolver = std::move(resolver); }
+
+        // Parses every lazy value, for code which reads the fields directly
+        void EnsureValues() { root->EnsureValues(); }
+
         
 	};
 }
\ No newline at end of file
@@ -1,358 +1,919 @@
 #pragma once
 #include "ContainersTree.hpp"
+#include "Expression.hpp"
+#include "..\Tokenization\Lexer.hpp"
+#include "..\Definitions\ThreadPool.hpp"
+#include <charconv>
+#include <span>
+#include <set>
+#include <deque>
+#include <utility>
 
 
 namespace DCL 
 {
-	struct TokensBlock
-	{
-		std::vector<Token> header;
-		std::vector<TokensBlock> body;
-	};
-
+    // Records of the lazy values of one tree and their parser. Kept by the tree: the records live as long as it does.
+    // Parsing takes one lock per tree: references parse the fields they point at under it, a cycle gives VOID
+    class LazyValues : public LazyResolver
+    {
+        std::shared_ptr<SymbolTable> symbols;
+        std::recursive_mutex mutex;
+        std::mutex blocks_mutex;
+        std::vector<std::unique_ptr<std::deque<LazyValue>>> blocks;    // One per part being built, records stay in place
 
-	class Decoder 
-	{
-        // ""    -    key-
-        std::unordered_map<std::string, std::shared_ptr<Container>> key_index;
-
-        bool m_debug_mode;
-        TokensBlock BuildBlocks(std::vector<Token>& tokens, size_t start_index = 0) {
-            TokensBlock current;
-            std::vector<Token> current_line;
+    public:
+        explicit LazyValues(std::shared_ptr<SymbolTable> symbols) : symbols(std::move(symbols)) {}
 
-            for (size_t i = start_index; i < tokens.size(); i++) {
-                Token& t = tokens[i];
+        // Storage for the records of one part, used by one thread
+        std::deque<LazyValue>* NewBlock()
+        {
+            std::lock_guard lock(blocks_mutex);
+            blocks.push_back(std::make_unique<std::deque<LazyValue>>());
+            return blocks.back().get();
+        }
 
-                if (t.value == "{") {
-                    int depth = 1;
-                    std::vector<Token> body;
-                    i++;
+        inline void Resolve(Field& field, LazyValue& value) override;
+    };
 
-                    while (depth > 0 && i < tokens.size()) {
-                        Token& inner_t = tokens[i];  //   !
+	// State of one decoding: everything that belongs to the tree under construction.
+	// Decoder creates a session per call, so decoding is re-entrant and threads can share Decoder::Get()
+	class DecodeSession 
+	{
+        friend class LazyValues;   // Parses lazy values with ParseValue
 
-                        if (inner_t.value == "{") depth++;
-                        if (inner_t.value == "}") depth--;
+    public:
+        // Top-level statement of a part: it ends before tokens[token_end] and made the part's fields before field_end
+        struct StatementBounds
+        {
+            size_t token_end;
+            size_t field_end;
+        };
 
-                        if (depth > 0) {
-                            body.push_back(inner_t);
-                        }
-                        else {
-                            //   }   
-                            //TokensBlock close_block;
-                            //close_block.header = { inner_t };
-                            //current.body.push_back(close_block);
-                        }
-                        i++;
-                    }
-                    i--;  //  
+        // Top-level fields [first, first + count) of a root to be replaced by all fields of part
+        struct Splice
+        {
+            size_t first;
+            size_t count;
+            std::shared_ptr<Container> part;
+        };
 
-                    //    
-                    auto tb = BuildBlocks(body);
-                    tb.header = current_line;  //   ( {)
-                    current.body.push_back(tb);
-                    current_line.clear();
-                    continue;
-                }
+    private:
+        // ""    -    key-
+        std::unordered_map<std::string, std::shared_ptr<Container>> key_index;
 
-                if (t.value == ";") {
-                    if (!current_line.empty()) {
-                        TokensBlock tb;
-                        tb.header = current_line;
-                        current.body.push_back(tb);
-                        current_line.clear();
-                    }
-                    continue;
-                }
+        // Interner of the tree being decoded
+        std::shared_ptr<SymbolTable> symbols;
 
-                current_line.push_back(t);
-            }
+        // Arena of the tree being decoded, nullptr when arena mode is off
+        std::shared_ptr<TreeStorage> storage;
 
-            //    ;
-            if (!current_line.empty()) {
-                TokensBlock tb;
-                tb.header = current_line;
-                current.body.push_back(tb);
-            }
+        // Records of the lazy values, nullptr when lazy mode is off
+        std::shared_ptr<LazyValues> lazy_values;
 
-            return current;
-        }
+        bool m_parallel_mode = false;
+        static constexpr size_t PARALLEL_MIN_TOKENS = 16 * 1024;
+        static constexpr size_t RENAMES_TO_REINDEX = 32;   // SpliceParts: more renamed fields than this rebuild the index
         // ===  1:   ===
 
+        // terminator is the ; or } which ends the statement, nullptr for the last statement of the input
         void BuildField(std::stack<std::shared_ptr<Container>>& containers_stack,
-            std::vector<Token>& tokens)
+            std::span<const Token> tokens, const Token* terminator, std::deque<LazyValue>* lazy)
         {
             if (containers_stack.empty() || tokens.empty()) return;
             auto current_context = containers_stack.top();
 
             //  
             if (tokens[0].value == "copy" && tokens.size() > 1) {
-                current_context->pending_copies.push_back(tokens[1].value);
+                current_context->pending_copies.push_back(symbols->Intern(tokens[1].value));
                 return;
             }
 
             if (tokens[0].value == "key") {
-                std::string field_name = tokens[1].value;
+                if (tokens.size() < 3) return;
+                Symbol field_name = symbols->Intern(tokens[1].value);
                 std::vector<Token> value_tokens(tokens.begin() + 3, tokens.end());
                 auto f = Field(field_name, Value(), true);
-                f.unresolved_tokens = value_tokens;
+                SetFieldValue(f, value_tokens);
 
-                current_context->ordered_fields.push_back(f);
+                current_context->AddField(std::move(f));
                 return;
             }
 
             //  
-            std::string field_name;
+            Symbol field_name;
             std::vector<Token> value_tokens;
+            if (lazy && terminator) {
+                size_t colon = FindAssignment(tokens);
+                if (colon == tokens.size()) return;
+                // Only the bytes between : and the terminator are kept (string tokens start after their quote)
+                const char* text = tokens[colon].value.data() + 1;
+                auto f = Field(symbols->Intern(tokens[colon - 1].value), Value(), false);
+                lazy->push_back({ lazy_values.get(), current_context.get(),
+                    static_cast<uint32_t>(current_context->ordered_fields.size()),
+                    static_cast<uint32_t>(terminator->value.data() - text), text, static_cast<uint32_t>(tokens[colon].line) });
+                f.lazy = &lazy->back();
+                current_context->AddField(std::move(f));
+                return;
+            }
             if (!ParseFieldAssignment(tokens, field_name, value_tokens)) {
                 return;
             }
 
             auto f = Field(field_name, Value(), false);
-            f.unresolved_tokens = value_tokens;
+            SetFieldValue(f, value_tokens);
+
+            current_context->AddField(std::move(f));
+
+        }
+
+        // Literals and expressions of literals don't depend on anything and are parsed (folded) right away,
+        // in parallel with other blocks. Everything else waits for the reference resolution
+        void SetFieldValue(Field& field, std::vector<Token>& value_tokens)
+        {
+            if (IsLiteralValue(value_tokens)) field.value = ParseValue(value_tokens, nullptr);
+            else field.unresolved_tokens = std::move(value_tokens);
+        }
 
-            current_context->ordered_fields.push_back(f);
+        static bool IsLiteralValue(std::span<const Token> tokens)
+        {
+            if (tokens.empty()) return false;
+            for (const Token& t : tokens) {
+                if (t.type & TokenType::LITERALS) continue;
+                if (t.type == TokenType::DELIMITER && (t.value == "[" || t.value == "]" || t.value == ",")) continue;
+                if (Expression::IsArithmetic(t)) continue;
+                return false;
+            }
+            return true;
+        }
 
+        // Position of the : after the field name, tokens.size() if there is none
+        static size_t FindAssignment(std::span<const Token> tokens)
+        {
+            for (size_t i = 1; i < tokens.size(); i++) {
+                if (tokens[i].value == ":" && tokens[i - 1].type == TokenType::IDENTIFIER) return i;
+            }
+            return tokens.size();
         }
 
-        bool ParseFieldAssignment(const std::vector<Token>& tokens,
-            std::string& field_name,
+        bool ParseFieldAssignment(std::span<const Token> tokens,
+            Symbol& field_name,
             std::vector<Token>& value_tokens)
         {
-            for (size_t i = 0; i < tokens.size(); i++) {
-                if (tokens[i].value == ":" && i > 0 && tokens[i - 1].type == TokenType::IDENTIFIER) {
-                    field_name = tokens[i - 1].value;
-                    for (size_t j = i + 1; j < tokens.size(); j++) {
-                        if (tokens[j].type != TokenType::END) {
-                            value_tokens.push_back(tokens[j]);
-                        }
-                    }
-                    return true;
+            size_t i = FindAssignment(tokens);
+            if (i == tokens.size()) return false;
+            field_name = symbols->Intern(tokens[i - 1].value);
+            for (size_t j = i + 1; j < tokens.size(); j++) {
+                if (tokens[j].type != TokenType::END) {
+                    value_tokens.push_back(tokens[j]);
                 }
             }
-            return false;
+            return true;
         }
 
-        std::shared_ptr<Container> BuildTree(TokensBlock block)
+        void OpenContainer(std::stack<std::shared_ptr<Container>>& containers_stack,
+            std::span<const Token> header, TreeStorage* arena)
         {
-            auto root_container = std::make_shared<Container>();
-            root_container->name = "root";
+            auto current_container = containers_stack.top();
+            auto child_container = NewContainer(arena);
+            child_container->parent = current_container.get();
+            ParseContainerHeader(header, *child_container);
+            auto f = Field(child_container->name, child_container);
+            f.isContainer = true;
+            current_container->AddField(std::move(f));
+            containers_stack.push(child_container);
+        }
 
+        // One pass over the tokens: statements are spans of the token vector, nesting is the stack
+        void BuildInto(std::shared_ptr<Container> root_container, std::span<const Token> tokens, TreeStorage* arena,
+            std::vector<StatementBounds>* statements = nullptr)
+        {
+            std::deque<LazyValue>* lazy = lazy_values ? lazy_values->NewBlock() : nullptr;
             std::stack<std::shared_ptr<Container>> containers_stack;
             containers_stack.push(root_container);
 
-            std::function<void(TokensBlock&, std::shared_ptr<Container>)> processBlock;
-
-            processBlock = [&](TokensBlock& current_block, std::shared_ptr<Container> current_container) {
-                for (auto& body_block : current_block.body) {
-                    if (IsContainerBlock(body_block)) {
-                        auto child_container = std::make_shared<Container>();
-                        child_container->parent = current_container;
-                        ParseContainerHeader(body_block.header, *child_container);
-                        auto f = Field(child_container->name, child_container);
-                        f.isContainer = true;
-                        current_container->ordered_fields.push_back(f);
-                        containers_stack.push(child_container);
-                        processBlock(body_block, child_container);
+            size_t statement_start = 0;
+            for (size_t i = 0; i < tokens.size(); i++) {
+                const Token& t = tokens[i];
+                std::span<const Token> statement = tokens.subspan(statement_start, i - statement_start);
+
+                if (t.type == TokenType::DELIMITER && t.value == "{") {
+                    OpenContainer(containers_stack, statement, arena);  //   ( {)
+                    statement_start = i + 1;
+                    continue;
+                }
+
+                if (t.type == TokenType::DELIMITER && t.value == "}") {
+                    BuildField(containers_stack, statement, &t, lazy);     //    ;
+                    if (containers_stack.size() > 1) containers_stack.pop();
+                    if (statements && containers_stack.size() == 1) statements->push_back({ i + 1, root_container->ordered_fields.size() });
+                    statement_start = i + 1;
+                    continue;
+                }
+
+                if (t.type == TokenType::END) {
+                    // "tag::x Name;" declares an empty container
+                    if (IsContainerHeader(statement)) {
+                        OpenContainer(containers_stack, statement, arena);
                         containers_stack.pop();
                     }
                     else {
-                        BuildField(containers_stack, body_block.header);
+                        BuildField(containers_stack, statement, &t, lazy);
                     }
+                    if (statements && containers_stack.size() == 1) statements->push_back({ i + 1, root_container->ordered_fields.size() });
+                    statement_start = i + 1;
                 }
-                };
+            }
+            BuildField(containers_stack, tokens.subspan(statement_start), nullptr, lazy);
+            // The rest is one more statement: unterminated, or inside a container which isn't closed
+            if (statements && (statements->empty() ? !tokens.empty() : statements->back().token_end < tokens.size()))
+                statements->push_back({ tokens.size(), root_container->ordered_fields.size() });
+        }
+
+        // Ends of top-level statements, grouped into chunks of about chunk_size tokens
+        static std::vector<size_t> SplitTopLevel(std::span<const Token> tokens, size_t chunk_size)
+        {
+            std::vector<size_t> ends;
+            size_t depth = 0;
+            size_t chunk_start = 0;
+            for (size_t i = 0; i < tokens.size(); i++) {
+                const Token& t = tokens[i];
+                bool statement_end = false;
+                if (t.type == TokenType::DELIMITER && t.value == "{") depth++;
+                else if (t.type == TokenType::DELIMITER && t.value == "}") {
+                    if (depth > 0) depth--;
+                    statement_end = depth == 0;
+                }
+                else if (t.type == TokenType::END) statement_end = depth == 0;
+
+                if (statement_end && i + 1 - chunk_start >= chunk_size) {
+                    ends.push_back(i + 1);
+                    chunk_start = i + 1;
+                }
+            }
+            if (chunk_start < tokens.size() || ends.empty()) ends.push_back(tokens.size());
+            return ends;
+        }
+
+        // Top-level blocks don't depend on each other while the structure is built,
+        // so large inputs are split into chunks built on the thread pool and joined in order
+        std::shared_ptr<Container> BuildTree(const std::vector<Token>& tokens)
+        {
+            auto root_container = NewRoot();
+
+            ThreadPool& pool = ThreadPool::Get();
+            if (!m_parallel_mode || pool.GetThreadsCount() < 2 || tokens.size() < PARALLEL_MIN_TOKENS) {
+                BuildInto(root_container, tokens, storage.get());
+                return root_container;
+            }
 
-            processBlock(block, root_container);
+            std::span<const Token> all(tokens);
+            auto ends = SplitTopLevel(all, tokens.size() / (pool.GetThreadsCount() * 4) + 1);
+            std::vector<std::shared_ptr<Container>> parts(ends.size());
+
+            TaskGroup group;
+            for (size_t i = 0; i < ends.size(); i++) {
+                size_t begin = i == 0 ? 0 : ends[i - 1];
+                pool.Run(group, [this, &parts, all, begin, end = ends[i], i]() {
+                    parts[i] = BuildPart(all.subspan(begin, end - begin));
+                    });
+            }
+            pool.Wait(group);
+
+            for (auto& part : parts) AppendPart(*root_container, *part);
             return root_container;
         }
 
         // ===  2:  ===
+        // Resolution runs on a dependency graph, not in declaration order:
+        //  1. copies are materialized container by container, sources before their targets, so a chain of copies
+        //     sees every field. A copied field which isn't resolved yet becomes an alias of its source field
+        //  2. every unresolved field (tokens or an alias) is a node, the fields its references point at and the
+        //     source of an alias are its dependencies
+        //  3. nodes are resolved exactly once in topological waves: fields of one wave don't depend on each other,
+        //     large waves are spread over the thread pool. Fields on a cycle are left VOID
+        static constexpr size_t PARALLEL_MIN_FIELDS = 4096;
+
+        struct PendingField
+        {
+            Container* context;         // Container the tokens are resolved in
+            Field* field;
+            Field* alias = nullptr;     // Source of a copied field, its value is taken as it is
+            uint32_t dependencies = 0;
+        };
+
+        // Copied field waiting for its source: slots, the fields themselves may still move while copies are added
+        struct CopiedField
+        {
+            Container* target;
+            size_t target_slot;
+            Container* source;
+            size_t source_slot;
+        };
+
+        // Pre-order, the order key fields are indexed in
+        static void CollectContainers(const std::shared_ptr<Container>& container, std::vector<std::shared_ptr<Container>>& containers)
+        {
+            containers.push_back(container);
+            for (auto& field : container->ordered_fields) {
+                if (field.isContainer && field.container) CollectContainers(field.container, containers);
+            }
+        }
 
-        void ResolveAllReferences(std::shared_ptr<Container> container)
+        void MaterializeCopies(const std::vector<std::shared_ptr<Container>>& containers, std::vector<CopiedField>& copied)
         {
-            std::string new_name = container->name; //  
+            // Copy sources are looked up before anything is copied: copies add no containers, so it's the same tree
+            std::unordered_map<Container*, size_t> order;
+            std::vector<size_t> targets;
+            for (size_t i = 0; i < containers.size(); i++) {
+                if (containers[i]->pending_copies.empty()) continue;
+                order[containers[i].get()] = targets.size();
+                targets.push_back(i);
+            }
+            if (targets.empty()) return;
+
+            std::vector<std::vector<std::shared_ptr<Container>>> sources(targets.size());
+            std::vector<std::vector<size_t>> dependents(targets.size());
+            std::vector<size_t> dependencies(targets.size(), 0);
+            for (size_t t = 0; t < targets.size(); t++) {
+                Container* target = containers[targets[t]].get();
+                for (Symbol source_name : target->pending_copies) {
+                    auto source = FindContainer(source_name, target);
+                    if (!source) continue;
+                    // A source with copies of its own is complete only after them
+                    if (auto it = order.find(source.get()); it != order.end() && it->second != t) {
+                        dependents[it->second].push_back(t);
+                        dependencies[t]++;
+                    }
+                    sources[t].push_back(std::move(source));
+                }
+            }
 
-            // 1.     key-
-            for (auto& field : container->ordered_fields) {
-                if (!field.unresolved_tokens.empty()) {
-                    field.value = ParseValue(field.unresolved_tokens, container);
-                    field.unresolved_tokens.clear();
+            std::vector<size_t> queue;
+            for (size_t t = 0; t < targets.size(); t++) if (dependencies[t] == 0) queue.push_back(t);
+            for (size_t i = 0; i < queue.size(); i++) {
+                for (size_t dependent : dependents[queue[i]]) {
+                    if (--dependencies[dependent] == 0) queue.push_back(dependent);
+                }
+            }
+            // Copies on a cycle are done as declared: they get what their sources have at that moment
+            for (size_t t = 0; t < targets.size(); t++) if (dependencies[t] != 0) queue.push_back(t);
+
+            std::set<std::pair<Container*, size_t>> pending;    // Copied slots which aren't resolved yet
+            for (size_t t : queue) {
+                Container* target = containers[targets[t]].get();
+                for (auto& source : sources[t]) ProcessCopy(*target, *source, pending, copied);
+                target->pending_copies.clear();
+            }
+        }
 
-                    //     key-
-                    if (field.isKey && !field.isContainer &&
-                        (field.value.type == ValueType::NUMBER || field.value.type == ValueType::STRING))
-                    {
-                        container->key = &field;
-                        key_index[field.value.ToString()] = container;
+        void ProcessCopy(Container& target, Container& source, std::set<std::pair<Container*, size_t>>& pending,
+            std::vector<CopiedField>& copied)
+        {
+            for (size_t slot = 0; slot < source.ordered_fields.size(); slot++) {
+                Field& field = source.ordered_fields[slot];
+                if (!field.isContainer) {
+                    // ,      .    ,     !
+                    if (target.HasField(field.name)) continue;
+
+                    // The value only: tokens stay with the source field, which is resolved in its own container.
+                    // A lazy value is shared, it's parsed in the source when either field is read
+                    Field& copy = target.AddField(Field(field.name, field.value, field.isKey));
+                    copy.lazy = field.lazy.load();
+                    if (!field.unresolved_tokens.empty() || pending.count({ &source, slot })) {
+                        size_t target_slot = target.ordered_fields.size() - 1;
+                        pending.insert({ &target, target_slot });
+                        copied.push_back({ &target, target_slot, &source, slot });
                     }
                 }
             }
-            for (const auto& source_name : container->pending_copies) {
-                ProcessCopy(container, source_name);
+        }
+
+        // Fields a value depends on: every reference ("Field", "A::B::Field") in its tokens
+        void CollectDependencies(std::span<const Token> tokens, Container* context, std::vector<Field*>& dependencies)
+        {
+            thread_local std::vector<Symbol> names;
+            for (size_t i = 0; i < tokens.size(); i++) {
+                if (tokens[i].type != TokenType::IDENTIFIER) continue;
+                names.clear();
+                names.push_back(symbols->Find(tokens[i].value));
+                while (i + 2 < tokens.size() && tokens[i + 1].value == "::" && tokens[i + 2].type == TokenType::IDENTIFIER) {
+                    names.push_back(symbols->Find(tokens[i + 2].value));
+                    i += 2;
+                }
+                if (Field* field = FindScopedField(names, context)) dependencies.push_back(field);
             }
-            container->pending_copies.clear();
+        }
 
-            // 
-            for (auto& field : container->ordered_fields) {
-                if (field.isContainer && field.container) {
-                    ResolveAllReferences(field.container);
+        void ResolveField(PendingField& node)
+        {
+            Field& field = *node.field;
+            if (node.alias) field.value = node.alias->value;
+            else field.value = ParseValue(field.unresolved_tokens, node.context);
+            field.unresolved_tokens = std::vector<Token>();    // Release the tokens memory, not only clear
+        }
+
+        void ResolveWave(std::vector<PendingField>& nodes, const std::vector<uint32_t>& wave)
+        {
+            ThreadPool& pool = ThreadPool::Get();
+            if (!m_parallel_mode || pool.GetThreadsCount() < 2 || wave.size() < PARALLEL_MIN_FIELDS) {
+                for (uint32_t id : wave) ResolveField(nodes[id]);
+                return;
+            }
+            size_t chunk = wave.size() / (pool.GetThreadsCount() * 4) + 1;
+            TaskGroup group;
+            for (size_t begin = 0; begin < wave.size(); begin += chunk) {
+                size_t end = std::min(begin + chunk, wave.size());
+                pool.Run(group, [this, &nodes, &wave, begin, end]() {
+                    for (size_t i = begin; i < end; i++) ResolveField(nodes[wave[i]]);
+                    });
+            }
+            pool.Wait(group);
+        }
+
+        // Resolves the top-level fields of root at slots and everything under them, the other top-level fields
+        // are resolved already
+        void ResolveGraph(const std::shared_ptr<Container>& root, std::span<const size_t> slots)
+        {
+            std::vector<std::shared_ptr<Container>> containers = { root };
+            for (size_t slot : slots) {
+                Field& field = root->ordered_fields[slot];
+                if (field.isContainer && field.container) CollectContainers(field.container, containers);
+            }
+
+            // Key fields are the declared ones, not copied
+            std::vector<size_t> own_fields(containers.size());
+            for (size_t i = 0; i < containers.size(); i++) own_fields[i] = containers[i]->ordered_fields.size();
+
+            // 1. Copies
+            std::vector<CopiedField> copied;
+            MaterializeCopies(containers, copied);
+
+            // 2. Graph: fields don't move any more
+            std::vector<PendingField> nodes;
+            std::unordered_map<Field*, uint32_t> node_of;
+            node_of.reserve(copied.size() + containers.size());
+            auto add_node = [&](Container* container, Field& field) {
+                if (field.unresolved_tokens.empty()) return;
+                node_of[&field] = static_cast<uint32_t>(nodes.size());
+                nodes.push_back({ container, &field });
+            };
+            for (size_t slot : slots) add_node(root.get(), root->ordered_fields[slot]);
+            for (size_t i = 1; i < containers.size(); i++) {
+                for (auto& field : containers[i]->ordered_fields) add_node(containers[i].get(), field);
+            }
+            for (const CopiedField& copy : copied) {
+                Field* field = &copy.target->ordered_fields[copy.target_slot];
+                node_of[field] = static_cast<uint32_t>(nodes.size());
+                nodes.push_back({ copy.source, field, &copy.source->ordered_fields[copy.source_slot] });
+            }
+            if (!nodes.empty()) {
+                // Edges (dependency, dependent), then grouped by dependency into one array
+                std::vector<std::pair<uint32_t, uint32_t>> edges;
+                std::vector<Field*> dependencies;
+                for (uint32_t id = 0; id < nodes.size(); id++) {
+                    PendingField& node = nodes[id];
+                    dependencies.clear();
+                    if (node.alias) dependencies.push_back(node.alias);
+                    else CollectDependencies(node.field->unresolved_tokens, node.context, dependencies);
+                    for (Field* dependency : dependencies) {
+                        auto it = node_of.find(dependency);
+                        if (it == node_of.end()) continue;      // Resolved already
+                        edges.emplace_back(it->second, id);
+                        node.dependencies++;
+                    }
+                }
+                std::vector<uint32_t> first_dependent(nodes.size() + 1, 0);
+                std::vector<uint32_t> dependents(edges.size());
+                for (const auto& edge : edges) first_dependent[edge.first + 1]++;
+                for (size_t i = 1; i < first_dependent.size(); i++) first_dependent[i] += first_dependent[i - 1];
+                {
+                    std::vector<uint32_t> position(first_dependent.begin(), first_dependent.end() - 1);
+                    for (const auto& edge : edges) dependents[position[edge.first]++] = edge.second;
+                }
+
+                // 3. Waves
+                std::vector<uint32_t> wave, next;
+                for (uint32_t id = 0; id < nodes.size(); id++) if (nodes[id].dependencies == 0) wave.push_back(id);
+                while (!wave.empty()) {
+                    ResolveWave(nodes, wave);
+                    next.clear();
+                    for (uint32_t id : wave) {
+                        for (uint32_t i = first_dependent[id]; i < first_dependent[id + 1]; i++) {
+                            if (--nodes[dependents[i]].dependencies == 0) next.push_back(dependents[i]);
+                        }
+                    }
+                    wave.swap(next);
+                }
+                for (PendingField& node : nodes) {
+                    if (node.dependencies == 0) continue;
+                    node.field->value = Value();     // On a cycle
+                    node.field->unresolved_tokens = std::vector<Token>();
+                }
+            }
+
+            // Key fields, the last one wins (literal keys are parsed while building). Of the root only the new ones
+            for (size_t i = 0; i < containers.size(); i++) {
+                Container& container = *containers[i];
+                size_t key_slot = container.ordered_fields.size();
+                auto index_key = [&](size_t slot) {
+                    Field& field = container.ordered_fields[slot];
+                    if (field.isKey && !field.isContainer &&
+                        (field.value.type == ValueType::NUMBER || field.value.type == ValueType::STRING))
+                    {
+                        key_slot = slot;
+                        key_index[field.value.ToString()] = containers[i];
+                    }
+                };
+                if (i == 0) {
+                    for (size_t slot : slots) index_key(slot);
                 }
+                else {
+                    for (size_t slot = 0; slot < own_fields[i]; slot++) index_key(slot);
+                }
+                if (key_slot < container.ordered_fields.size()) container.key = &container.ordered_fields[key_slot];
             }
         }
 
-        Value ParseValue(const std::vector<Token>& tokens, std::shared_ptr<Container> current_context)
+        Value ParseValue(std::span<const Token> tokens, Container* current_context)
         {
             if (tokens.empty()) return Value();
 
             // 
             if (tokens[0].value == "[") {
-                auto array_val = std::make_shared<std::vector<Value>>();
+                if (auto numbers = ParseNumericArray(tokens); !numbers.empty()) return Value(std::move(numbers));
+
+                // Items are split at commas outside of nested brackets, every item is a value of its own
+                std::vector<Value> array_val;
+                size_t depth = 0, item_start = 1;
                 for (size_t i = 1; i < tokens.size(); i++) {
-                    if (tokens[i].value == "]") break;
-                    if (tokens[i].value == ",") continue;
-                    std::vector<Token> element_tokens = { tokens[i] };
-                    array_val->push_back(ParseValue(element_tokens, current_context));
+                    std::string_view v = tokens[i].value;
+                    bool closing = depth == 0 && v == "]";
+                    if (closing || (depth == 0 && v == ",")) {
+                        if (i > item_start) array_val.push_back(ParseValue(tokens.subspan(item_start, i - item_start), current_context));
+                        item_start = i + 1;
+                        if (closing) break;
+                    }
+                    else if (v == "[" || v == "(") depth++;
+                    else if ((v == "]" || v == ")") && depth > 0) depth--;
                 }
-                return Value(array_val);
+                return Value(std::move(array_val));
             }
 
             //  
             if (tokens.size() == 1) {
                 const Token& t = tokens[0];
-                if (t.type == TokenType::NUMBER_LITERAL) return Value(std::stod(t.value));
+                if (t.type == TokenType::NUMBER_LITERAL) return Value(ParseNumber(t.value));
                 if (t.type == TokenType::STRING_LITERAL) return Value(t.value);
                 if (t.type == TokenType::BOOL_LITERAL) return Value(t.value == "true");
                 if (t.type == TokenType::IDENTIFIER) {
-                    return FindFieldInContainers(t.value, current_context);
+                    Symbol name = symbols->Find(t.value);
+                    return FindScopedValue(std::span<const Symbol>(&name, 1), current_context);
                 }
             }
 
             // Scoped 
-            if (tokens.size() >= 3 && tokens[1].value == "::") {
-                std::string container_name = tokens[0].value;
-                std::string field_name = tokens[2].value;
-                auto container = FindContainer(container_name, current_context);
-                if (container) {
-                    for (auto& f : container->ordered_fields) 
-                    {
-                        if (f.name == field_name && !f.isContainer) 
-                        {
-                            return f.value;
-                        }
-                    }
-                }
+            if (tokens.size() == 3 && tokens[1].value == "::") {
+                Symbol names[] = { symbols->Find(tokens[0].value), symbols->Find(tokens[2].value) };
+                return FindScopedValue(names, current_context);
             }
 
-            return Value();
+            // : "SContainer::Key * 1200"
+            Expression expression;     // Not shared: evaluation can parse lazy values it refers to
+            if (!Expression::Compile(tokens, *symbols, expression)) {
+                if (expression.IsNotFinite()) ReportNotFinite(tokens);
+                return Value();
+            }
+            bool not_finite = false;
+            Value result = expression.Evaluate([this, current_context](std::span<const Symbol> names) {
+                return FindScopedValue(names, current_context);
+                }, &not_finite);
+            if (not_finite) ReportNotFinite(tokens);
+            return result;
         }
 
-        void ProcessCopy(std::shared_ptr<Container> target, const std::string& source_name)
+        // The field becomes VOID: inf and nan have no text form to serialize to
+        static void ReportNotFinite(std::span<const Token> tokens)
         {
-            auto source = FindContainer(source_name, target);
-            if (!source) return;
+            std::cout << "Expression isn't finite (division by zero?) at line " << tokens.front().line + 1 << "\n";
+        }
 
-            for (auto& field : source->ordered_fields) {
-                if (!field.isContainer) {
-                    // ,      .    ,     !
-                    bool skip = false;
-                    for (auto& f : target->ordered_fields)
-                    {
-                        if (f.name == field.name)
-                        {
-                            skip = true;
-                            break;
-                        }
-                    }
-                    if (skip) continue;
+        Value FindScopedValue(std::span<const Symbol> names, Container* start)
+        {
+            Field* f = FindScopedField(names, start);
+            return f ? f->value : Value();
+        }
 
-                    if (field.unresolved_tokens.size() > 0) {
-                        field.value = ParseValue(field.unresolved_tokens, source);
-                        field.unresolved_tokens.clear();
-                    }
+        // ===   ===
+
+        std::shared_ptr<Container> NewContainer(TreeStorage* arena)
+        {
+            auto container = arena ? arena->NewContainer() : std::make_shared<Container>();
+            container->symbols = symbols.get();
+            return container;
+        }
 
-                    target->ordered_fields.push_back(field);
+        static double ParseNumber(std::string_view text)
+        {
+            double result = 0;
+            std::from_chars(text.data(), text.data() + text.size(), result);
+            return result;
+        }
+
+        // [1, -2.5, 3] straight into a double buffer, empty if any element isn't a (negated) number literal
+        static std::vector<double> ParseNumericArray(std::span<const Token> tokens)
+        {
+            std::vector<double> numbers;
+            numbers.reserve(tokens.size() / 2 + 1);
+            bool item = false;      // A number since the last comma
+            for (size_t i = 1; i < tokens.size(); i++) {
+                if (tokens[i].value == "]") break;
+                if (tokens[i].value == ",") {
+                    item = false;
+                    continue;
                 }
+                bool negative = tokens[i].value == "-" && i + 1 < tokens.size();
+                if (negative) i++;
+                if (item || tokens[i].type != TokenType::NUMBER_LITERAL) return {};
+                numbers.push_back(negative ? -ParseNumber(tokens[i].value) : ParseNumber(tokens[i].value));
+                item = true;
             }
+            return numbers;
         }
 
-        // ===   ===
-
-        Value FindFieldInContainers(const std::string& field_name, std::shared_ptr<Container> start)
+        // "Field" goes up the containers for the field, "A::B::Field" goes up for A and then down by names
+        Field* FindScopedField(std::span<const Symbol> names, Container* start)
         {
-            auto current = start;
-            while (current != nullptr) {
-                for (auto& f : current->ordered_fields)
-                {
-                    if (f.name == field_name)
-                    {
-                        return f.value;
-                    }
+            if (names.size() == 1) {
+                for (Container* current = start; current != nullptr; current = current->parent) {
+                    if (Field* f = current->FindField(names[0])) return f;
                 }
-                current = current->parent;
+                return nullptr;
             }
-            return Value();
+            auto container = FindContainer(names[0], start);
+            for (size_t i = 1; container && i + 1 < names.size(); i++) container = container->FindChild(names[i]);
+            return container ? container->FindField(names.back(), false) : nullptr;
         }
 
-        std::shared_ptr<Container> FindContainer(const std::string& name, std::shared_ptr<Container> start)
+        std::shared_ptr<Container> FindContainer(Symbol name, Container* start)
         {
             auto current = start;
             while (current != nullptr) {
-                for (const auto& field : current->ordered_fields) {
-                    if (field.isContainer && field.container->name == name) {
-                        return field.container;
-                    }
-                }
+                if (auto container = current->FindChild(name)) return container;
                 current = current->parent;
             }
             return nullptr;
         }
 
-        bool IsContainerBlock(const TokensBlock& block) {
-            if (block.body.size() > 0) return true;
-            for (size_t i = 0; i < block.header.size(); i++) {
-                if (block.header[i].value == "tag" && i + 1 < block.header.size() &&
-                    block.header[i + 1].value == "::") {
+        bool IsContainerHeader(std::span<const Token> header) {
+            for (size_t i = 0; i + 1 < header.size(); i++) {
+                if (header[i].value == "tag" && header[i + 1].value == "::") {
                     return true;
                 }
             }
             return false;
         }
 
-        void ParseContainerHeader(const std::vector<Token>& header, Container& container) {
+        void ParseContainerHeader(std::span<const Token> header, Container& container) {
             for (size_t i = 0; i < header.size(); i++) {
                 if (header[i].value == "tag" && i + 2 < header.size() &&
                     header[i + 1].value == "::") {
-                    container.tag = header[i + 2].value;
+                    container.tag = symbols->Intern(header[i + 2].value);
                     i += 2;
                 }
-                else if (header[i].type == TokenType::IDENTIFIER && container.name == "container0") {
-                    container.name = header[i].value;
+                else if (header[i].type == TokenType::IDENTIFIER && container.name == SymbolTable::DEFAULT_NAME) {
+                    container.name = symbols->Intern(header[i].value);
                 }
             }
         }
+    public:
+        DecodeSession(std::shared_ptr<SymbolTable> symbols, std::shared_ptr<TreeStorage> storage, bool parallel_mode,
+            bool lazy_mode = false)
+            : symbols(std::move(symbols)), storage(std::move(storage)), m_parallel_mode(parallel_mode)
+        {
+            if (lazy_mode) lazy_values = std::make_shared<LazyValues>(this->symbols);
+        }
+
+        //Forbid copying
+        DecodeSession(const DecodeSession&) = delete;
+        DecodeSession& operator=(const DecodeSession&) = delete;
+
+        //  1:  
+        std::shared_ptr<Container> Build(const std::vector<Token>& tokens) { return BuildTree(tokens); }
+
+        // Structure of independent top-level statements (a chunk, a whole file) in a detached container.
+        // Thread-safe: parts of one session can be built in parallel and appended in order afterwards
+        // statements, when given, receive the bounds of every top-level statement
+        std::shared_ptr<Container> BuildPart(std::span<const Token> tokens, std::vector<StatementBounds>* statements = nullptr)
+        {
+            TreeStorage* arena = storage ? storage->CreateChild() : nullptr;
+            auto part = std::make_shared<Container>();
+            part->symbols = symbols.get();
+            BuildInto(part, tokens, arena, statements);
+            return part;
+        }
+
+        std::shared_ptr<Container> NewRoot()
+        {
+            auto root_container = NewContainer(storage.get());
+            root_container->name = SymbolTable::ROOT;
+            return root_container;
+        }
+
+        // Moves the fields of part into root, the part is left empty
+        static void AppendPart(Container& root_container, Container& part)
+        {
+            for (auto& field : part.ordered_fields) {
+                if (field.isContainer && field.container) field.container->parent = &root_container;
+                if (LazyValue* lazy = field.lazy.load(); lazy && lazy->owner == &part) {
+                    lazy->owner = &root_container;
+                    lazy->slot = static_cast<uint32_t>(root_container.ordered_fields.size());
+                }
+                root_container.AddField(std::move(field));
+            }
+            for (Symbol copy : part.pending_copies) root_container.pending_copies.push_back(copy);
+            part.ordered_fields.clear();
+            part.field_index.clear();
+            part.pending_copies.clear();
+        }
+
+        // Replaces runs of top-level fields of root with the fields of parts in one pass, the parts are left empty
+        // as by AppendPart. splices are ordered and don't overlap; slots of the fields taken from parts go to inserted
+        static void SpliceParts(Container& root_container, std::span<const Splice> splices, std::vector<size_t>& inserted)
+        {
+            auto& old_fields = root_container.ordered_fields;
+            auto take = [&](Container& part) {
+                for (Symbol copy : part.pending_copies) root_container.pending_copies.push_back(copy);
+                part.ordered_fields.clear();
+                part.field_index.clear();
+                part.pending_copies.clear();
+            };
+
+            // A field for a field, as after an edit of values: the others stay where they are
+            bool in_place = std::all_of(splices.begin(), splices.end(),
+                [](const Splice& splice) { return splice.part->ordered_fields.size() == splice.count; });
+            if (in_place) {
+                std::vector<Symbol> renamed;    // Old and new names of fields whose name changed
+                for (const Splice& splice : splices) {
+                    for (size_t i = 0; i < splice.count; i++) {
+                        Field& field = splice.part->ordered_fields[i];
+                        size_t slot = splice.first + i;
+                        if (field.isContainer && field.container) field.container->parent = &root_container;
+                        if (LazyValue* lazy = field.lazy.load(); lazy && lazy->owner == splice.part.get()) {
+                            lazy->owner = &root_container;
+                            lazy->slot = static_cast<uint32_t>(slot);
+                        }
+                        if (old_fields[slot].name != field.name) {
+                            renamed.push_back(old_fields[slot].name);
+                            renamed.push_back(field.name);
+                        }
+                        // Constructed anew: assignment keeps isContainer of the old field
+                        std::destroy_at(&old_fields[slot]);
+                        std::construct_at(&old_fields[slot], std::move(field));
+                        inserted.push_back(slot);
+                    }
+                    take(*splice.part);
+                }
+                // A few renames: the first slot of each name is looked for again, a scan without hashing
+                if (renamed.size() > RENAMES_TO_REINDEX) {
+                    root_container.RebuildIndex();
+                    return;
+                }
+                for (Symbol name : renamed) {
+                    root_container.field_index.erase(name);
+                    for (size_t slot = 0; slot < old_fields.size(); slot++) {
+                        if (old_fields[slot].name != name) continue;
+                        root_container.field_index.emplace(name, slot);
+                        break;
+                    }
+                }
+                return;
+            }
+
+            std::pmr::vector<Field> fields(old_fields.get_allocator());
+            fields.reserve(old_fields.size());
+            auto move_field = [&](Field& field, Container* owner) {
+                if (field.isContainer && field.container) field.container->parent = &root_container;
+                // Declared lazy values of root follow their fields
+                if (LazyValue* lazy = field.lazy.load(); lazy && lazy->owner == owner) {
+                    lazy->owner = &root_container;
+                    lazy->slot = static_cast<uint32_t>(fields.size());
+                }
+                fields.push_back(std::move(field));
+            };
+
+            size_t slot = 0;
+            for (const Splice& splice : splices) {
+                for (; slot < splice.first; slot++) move_field(old_fields[slot], &root_container);
+                slot += splice.count;   // Replaced fields go with the old vector
+                for (auto& field : splice.part->ordered_fields) {
+                    inserted.push_back(fields.size());
+                    move_field(field, splice.part.get());
+                }
+                take(*splice.part);
+            }
+            for (; slot < old_fields.size(); slot++) move_field(old_fields[slot], &root_container);
+
+            old_fields = std::move(fields);
+            root_container.RebuildIndex();
+        }
+
+        //  2: 
+        void Resolve(std::shared_ptr<Container> root) { ResolveFrom(root, 0); }
+
+        // Resolves the top-level fields appended to root since first_slot, earlier ones are left as they are.
+        // References may point anywhere in the tree built so far
+        void ResolveFrom(std::shared_ptr<Container> root, size_t first_slot)
+        {
+            std::vector<size_t> slots(root->ordered_fields.size() - std::min(first_slot, root->ordered_fields.size()));
+            for (size_t i = 0; i < slots.size(); i++) slots[i] = first_slot + i;
+            ResolveGraph(root, slots);
+        }
+
+        // Resolves the top-level fields of root at slots (as SpliceParts gives them), the rest of root is resolved already
+        void ResolveSlots(std::shared_ptr<Container> root, std::span<const size_t> slots) { ResolveGraph(root, slots); }
+
+        // Keys indexed since the last call, the session forgets them: for trees which are patched after MakeTree
+        std::unordered_map<std::string, std::shared_ptr<Container>> TakeKeyIndex() { return std::exchange(key_index, {}); }
+
+        // The tree retains source, tokens are spans over it
+        std::shared_ptr<ContainersTree> MakeTree(std::shared_ptr<Container> root, std::shared_ptr<SourceBuffer> source)
+        {
+            auto tree = std::make_shared<ContainersTree>(root, key_index, symbols, std::move(source), std::move(storage));
+            if (lazy_values) tree->RetainLazyResolver(lazy_values);
+            return tree;
+        }
+        std::shared_ptr<ContainersTree> MakeTree(std::shared_ptr<Container> root, std::vector<std::shared_ptr<SourceBuffer>> sources)
+        {
+            auto tree = MakeTree(std::move(root), nullptr);
+            for (auto& source : sources) tree->RetainSource(std::move(source));
+            return tree;
+        }
+    };
+
+    // Holds only settings: the state of a decoding lives in its DecodeSession
+    class Decoder
+    {
+        bool m_debug_mode = false;
+        bool m_arena_mode = false;
+        bool m_parallel_mode = false;
+        bool m_lazy_mode = false;
+
     public:
         void SetDebugMode(bool value) { m_debug_mode = value; }
+        // Containers of decoded trees are placed in one arena owned by the tree and released at once.
+        // Container handles of such a tree don't keep it alive: keep the tree while using them
+        void SetArenaMode(bool value) { m_arena_mode = value; }
+        // Top-level blocks of large inputs are built on ThreadPool::Get(), references are resolved after that
+        void SetParallelMode(bool value) { m_parallel_mode = value; }
+        // Values are parsed on the first FindField (GetField, queries) instead of while decoding, key fields excepted.
+        // The source and the tree must outlive the containers used; reading Field::value of a field got some other
+        // way (ordered_fields, GetGlobalFields) needs Field::EnsureValue or ContainersTree::EnsureValues first
+        void SetLazyMode(bool value) { m_lazy_mode = value; }
         static Decoder& Get()
         {
             static Decoder decoder;
             return decoder;
         }
-        std::shared_ptr<ContainersTree> Decode(std::vector<Token>& tokens)
+        // The tree retains source, tokens are spans over it
+        std::shared_ptr<ContainersTree> Decode(const std::vector<Token>& tokens, std::shared_ptr<SourceBuffer> source = nullptr) const
         {
-            key_index.clear();
-            //  1:  
-            TokensBlock tb = BuildBlocks(tokens);
-            auto root_container = BuildTree(tb);
-
-            //  2: 
-            ResolveAllReferences(root_container);
-
-            auto CT = std::make_shared<ContainersTree>(root_container->ordered_fields, key_index);
-            return CT;
+            DecodeSession session(std::make_shared<SymbolTable>(),
+                m_arena_mode ? std::make_shared<TreeStorage>() : nullptr, m_parallel_mode, m_lazy_mode);
+            auto root_container = session.Build(tokens);
+            session.Resolve(root_container);
+            return session.MakeTree(root_container, std::move(source));
         }
     };
 
-}
 
+    inline void LazyValues::Resolve(Field& field, LazyValue& value)
+    {
+        std::lock_guard lock(mutex);
+        if (field.lazy.load(std::memory_order_relaxed) != &value) return;  // Parsed by another thread meanwhile
+        if (value.resolving) return;                                        // On a cycle: stays VOID
+
+        Field& declared = value.owner->ordered_fields[value.slot];
+        if (&declared != &field) {
+            // A copy takes the value of the field it was copied from
+            declared.EnsureValue();
+            field.value = declared.value;
+            field.lazy.store(nullptr, std::memory_order_release);
+            return;
+        }
+
+        value.resolving = true;
+        auto source = SourceBuffer::FromString(std::string(value.text, value.size));
+        std::vector<Token> tokens;
+        Lexer::Cursor cursor = Lexer::Begin(*source);
+        Token token;
+        while (Lexer::Next(cursor, token)) {
+            token.line += value.line;   // Lines of the value's text, as the eager decoder reports them
+            tokens.push_back(token);
+        }
 
+        DecodeSession session(symbols, nullptr, false);
+        field.value = session.ParseValue(tokens, value.owner);
+        value.resolving = false;
+        field.lazy.store(nullptr, std::memory_order_release);
+    }
+}
\ No newline at end of file
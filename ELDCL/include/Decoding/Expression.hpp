@@ -0,0 +1,287 @@
+#pragma once
+#include "..\Tokenization\TokensInfo.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+namespace DCL
+{
+    // Arithmetic of field values: "SContainer::Key * 1200", "-(A + 2) / B".
+    // Tokens are compiled once into postfix bytecode for a stack machine, constant subexpressions are folded
+    // while compiling, so an expression without references becomes a single constant.
+    // Operands are numbers: a reference to anything else makes the result VOID. A lone reference keeps its type.
+    // Results which aren't finite (division by zero, overflow) are VOID too: the text format can't hold them
+    class Expression
+    {
+    public:
+        enum class OpCode : uint8_t { CONSTANT, LOAD, ADD, SUBTRACT, MULTIPLY, DIVIDE, NEGATE };
+
+        struct Instruction
+        {
+            OpCode op;
+            uint32_t operand = 0;       // CONSTANT: index in constants, LOAD: index in references
+        };
+
+        // Scoped name "A::B::C": names[first .. first + count), the last one is the field
+        struct Reference
+        {
+            uint32_t first;
+            uint32_t count;
+        };
+
+    private:
+        static constexpr size_t MAX_NESTING = 256;
+        static constexpr size_t INLINE_STACK = 16;
+
+        std::vector<Instruction> code;
+        std::vector<double> constants;
+        std::vector<Reference> references;
+        std::vector<Symbol> names;
+        size_t max_stack = 0;
+        bool not_finite = false;        // A constant subexpression folded to inf or nan
+
+        // Recursive descent, every rule leaves its result on top of the stack
+        class Compiler
+        {
+            std::span<const Token> tokens;
+            const SymbolTable& symbols;
+            Expression& out;
+            size_t position = 0;
+            size_t stack = 0;
+            size_t nesting = 0;
+            bool failed = false;
+
+            bool Is(std::string_view text) const
+            {
+                return position < tokens.size() && tokens[position].value == text;
+            }
+
+            void Push()
+            {
+                out.max_stack = std::max(out.max_stack, ++stack);
+            }
+
+            void EmitConstant(double value)
+            {
+                out.constants.push_back(value);
+                out.code.push_back({ OpCode::CONSTANT, static_cast<uint32_t>(out.constants.size() - 1) });
+                Push();
+            }
+
+            // Two constants on top are replaced with their result: their constants are the last ones too
+            void EmitBinary(OpCode op)
+            {
+                stack--;
+                auto& code = out.code;
+                size_t size = code.size();
+                if (size >= 2 && code[size - 1].op == OpCode::CONSTANT && code[size - 2].op == OpCode::CONSTANT) {
+                    auto& constants = out.constants;
+                    double right = constants.back();
+                    constants.pop_back();
+                    constants.back() = Apply(op, constants.back(), right);
+                    code.pop_back();
+                    if (!std::isfinite(constants.back())) {
+                        out.not_finite = true;
+                        failed = true;
+                    }
+                    return;
+                }
+                code.push_back({ op });
+            }
+
+            void EmitNegate()
+            {
+                if (!out.code.empty() && out.code.back().op == OpCode::CONSTANT) {
+                    out.constants.back() = -out.constants.back();
+                    return;
+                }
+                out.code.push_back({ OpCode::NEGATE });
+            }
+
+            void ParseSum()
+            {
+                ParseProduct();
+                while (!failed && (Is("+") || Is("-"))) {
+                    OpCode op = tokens[position++].value == "+" ? OpCode::ADD : OpCode::SUBTRACT;
+                    ParseProduct();
+                    EmitBinary(op);
+                }
+            }
+
+            void ParseProduct()
+            {
+                ParseUnary();
+                while (!failed && (Is("*") || Is("/"))) {
+                    OpCode op = tokens[position++].value == "*" ? OpCode::MULTIPLY : OpCode::DIVIDE;
+                    ParseUnary();
+                    EmitBinary(op);
+                }
+            }
+
+            void ParseUnary()
+            {
+                if (++nesting > MAX_NESTING) {
+                    failed = true;
+                    return;
+                }
+                if (Is("-")) {
+                    position++;
+                    ParseUnary();
+                    if (!failed) EmitNegate();
+                }
+                else if (Is("+")) {
+                    position++;
+                    ParseUnary();
+                }
+                else {
+                    ParsePrimary();
+                }
+                nesting--;
+            }
+
+            void ParsePrimary()
+            {
+                if (position >= tokens.size()) {
+                    failed = true;
+                    return;
+                }
+                const Token& t = tokens[position];
+                if (t.type == TokenType::NUMBER_LITERAL) {
+                    double value = 0;
+                    std::from_chars(t.value.data(), t.value.data() + t.value.size(), value);
+                    EmitConstant(value);
+                    position++;
+                    return;
+                }
+                if (t.value == "(") {
+                    position++;
+                    ParseSum();
+                    if (!Is(")")) failed = true;
+                    position++;
+                    return;
+                }
+                if (t.type == TokenType::IDENTIFIER) {
+                    Reference reference{ static_cast<uint32_t>(out.names.size()), 0 };
+                    while (true) {
+                        // Unknown names stay NO_SYMBOL and resolve to VOID
+                        out.names.push_back(symbols.Find(tokens[position++].value));
+                        reference.count++;
+                        if (!Is("::")) break;
+                        position++;
+                        if (position >= tokens.size() || tokens[position].type != TokenType::IDENTIFIER) {
+                            failed = true;
+                            return;
+                        }
+                    }
+                    out.references.push_back(reference);
+                    out.code.push_back({ OpCode::LOAD, static_cast<uint32_t>(out.references.size() - 1) });
+                    Push();
+                    return;
+                }
+                failed = true;
+            }
+
+        public:
+            Compiler(std::span<const Token> tokens, const SymbolTable& symbols, Expression& out)
+                : tokens(tokens), symbols(symbols), out(out) {}
+
+            bool Run()
+            {
+                ParseSum();
+                return !failed && position == tokens.size();
+            }
+        };
+
+        static double Apply(OpCode op, double left, double right)
+        {
+            switch (op) {
+            case OpCode::ADD: return left + right;
+            case OpCode::SUBTRACT: return left - right;
+            case OpCode::MULTIPLY: return left * right;
+            case OpCode::DIVIDE: return left / right;
+            default: return 0;
+            }
+        }
+
+    public:
+        // false if the tokens aren't an arithmetic expression, expression is left in an unspecified state then
+        static bool Compile(std::span<const Token> tokens, const SymbolTable& symbols, Expression& expression)
+        {
+            // Cleared, not replaced: an expression reused for many compilations keeps its buffers
+            expression.code.clear();
+            expression.constants.clear();
+            expression.references.clear();
+            expression.names.clear();
+            expression.max_stack = 0;
+            expression.not_finite = false;
+            if (tokens.empty()) return false;
+            Compiler compiler(tokens, symbols, expression);
+            return compiler.Run();
+        }
+
+        // Arithmetic operators and parentheses, the rest of tokens are operands
+        static bool IsArithmetic(const Token& t)
+        {
+            if (t.value.size() != 1) return false;
+            if (t.type == TokenType::OPERATOR) return t.value != ":";
+            return t.type == TokenType::DELIMITER && (t.value == "(" || t.value == ")");
+        }
+
+        bool IsConstant() const { return code.size() == 1 && code[0].op == OpCode::CONSTANT; }
+        // Compile failed because a constant part of the expression isn't finite
+        bool IsNotFinite() const { return not_finite; }
+        bool HasReferences() const { return !references.empty(); }
+
+        const std::vector<Instruction>& GetCode() const { return code; }
+        const std::vector<Reference>& GetReferences() const { return references; }
+        std::span<const Symbol> GetNames(const Reference& reference) const
+        {
+            return std::span<const Symbol>(names).subspan(reference.first, reference.count);
+        }
+
+        // resolve(std::span<const Symbol> scoped_name) -> Value. A result which isn't finite is VOID,
+        // *not_finite tells it from the other VOIDs
+        template<typename Resolve>
+        Value Evaluate(Resolve&& resolve, bool* not_finite = nullptr) const
+        {
+            if (code.empty()) return Value();
+            if (IsConstant()) return Value(constants[0]);
+            if (code.size() == 1) return resolve(GetNames(references[code[0].operand]));
+
+            double inline_stack[INLINE_STACK];
+            std::vector<double> heap_stack;
+            double* stack = inline_stack;
+            if (max_stack > INLINE_STACK) {
+                heap_stack.resize(max_stack);
+                stack = heap_stack.data();
+            }
+
+            size_t top = 0;
+            for (const Instruction& instruction : code) {
+                switch (instruction.op) {
+                case OpCode::CONSTANT:
+                    stack[top++] = constants[instruction.operand];
+                    break;
+                case OpCode::LOAD: {
+                    Value value = resolve(GetNames(references[instruction.operand]));
+                    if (value.type != ValueType::NUMBER) return Value();
+                    stack[top++] = value.AsNumber();
+                    break;
+                }
+                case OpCode::NEGATE:
+                    stack[top - 1] = -stack[top - 1];
+                    break;
+                default:
+                    top--;
+                    stack[top - 1] = Apply(instruction.op, stack[top - 1], stack[top]);
+                    if (!std::isfinite(stack[top - 1])) {
+                        if (not_finite) *not_finite = true;
+                        return Value();
+                    }
+                    break;
+                }
+            }
+            return Value(stack[0]);
+        }
+    };
+}
@@ -0,0 +1,347 @@
+#pragma once
+#include "..\Tokenization\SourceBuffer.hpp"
+#include "..\Definitions\Types.hpp"
+#include "..\Definitions\StringOperations.hpp"
+#include "..\Serialization\BinaryFormat.hpp"
+#include <span>
+#include <queue>
+#include <bit>
+#include <algorithm>
+
+
+namespace DCL
+{
+    // Read-only tree over a frozen image (Serializator::SerializeFrozen), usually a mapped file.
+    // Nothing is deserialized: the views below are offsets into the image, lookups are binary searches
+    // over its sorted tables. Processes mapping the same file share its pages.
+    // Only the header is checked when opening, records are bounds-checked as they are read:
+    // a broken image gives empty views, never reads outside of itself.
+    // Views are valid while the FrozenTree lives.
+    class FrozenTree
+    {
+        using Header = BinaryFormat::FrozenHeader;
+
+        std::shared_ptr<SourceBuffer> image;
+        const char* data = nullptr;
+        const Header* header = nullptr;
+
+        template<typename T>
+        const T* Table(uint64_t offset) const { return reinterpret_cast<const T*>(data + offset); }
+
+        std::string_view String(const BinaryFormat::FrozenString& string) const
+        {
+            if (string.offset > header->strings_size || string.size > header->strings_size - string.offset) return {};
+            return std::string_view(data + header->strings_offset + string.offset, string.size);
+        }
+
+        // Section of count records of size bytes inside the image, 8-aligned
+        bool HasSection(uint64_t offset, uint64_t count, uint64_t size) const
+        {
+            return offset % 8 == 0 && offset <= header->size && count <= (header->size - offset) / size;
+        }
+
+        bool Validate() const
+        {
+            if (image->Size() < sizeof(Header) || reinterpret_cast<uintptr_t>(data) % 8 != 0) return false;
+            if (!BinaryFormat::HasMagic(image->Text()) || header->version != BinaryFormat::FROZEN_VERSION) return false;
+            if (header->size != image->Size()) return false;
+            return HasSection(header->symbols_offset, header->symbols_count, sizeof(BinaryFormat::FrozenString)) &&
+                HasSection(header->symbol_order_offset, header->symbols_count, sizeof(uint32_t)) &&
+                HasSection(header->containers_offset, header->containers_count, sizeof(BinaryFormat::FrozenContainer)) &&
+                HasSection(header->fields_offset, header->fields_count, sizeof(BinaryFormat::FrozenField)) &&
+                HasSection(header->field_order_offset, header->fields_count, sizeof(uint32_t)) &&
+                HasSection(header->keys_offset, header->keys_count, sizeof(BinaryFormat::FrozenKey)) &&
+                HasSection(header->strings_offset, header->strings_size, 1) &&
+                HasSection(header->values_offset, header->values_size, 1) &&
+                header->containers_count > 0;
+        }
+
+        explicit FrozenTree(std::shared_ptr<SourceBuffer> image)
+            : image(std::move(image)), data(this->image->Text().data()), header(reinterpret_cast<const Header*>(data)) {}
+
+    public:
+        class ContainerView;
+
+        class ValueView
+        {
+            friend class FrozenTree;
+            friend class FieldView;
+            const FrozenTree* tree = nullptr;
+            const BinaryFormat::FrozenValue* record = nullptr;
+
+            ValueView(const FrozenTree* tree, uint64_t offset) : tree(tree)
+            {
+                const Header& header = *tree->header;
+                if (offset % 8 != 0 || offset > header.values_size || header.values_size - offset < sizeof(BinaryFormat::FrozenValue)) return;
+                const auto* candidate = tree->Table<BinaryFormat::FrozenValue>(header.values_offset + offset);
+                uint64_t left = header.values_size - offset - sizeof(BinaryFormat::FrozenValue);
+                uint64_t payload = 0;
+                if (candidate->type == ValueType::NUMBER) payload = sizeof(double);
+                else if (candidate->type == ValueType::STRING) payload = candidate->size;
+                else if (candidate->type == ValueType::ARRAY)
+                    payload = uint64_t(candidate->size) * (candidate->flags & BinaryFormat::VALUE_NUMERIC ? sizeof(double) : sizeof(uint32_t));
+                if (payload <= left) record = candidate;
+            }
+
+            const char* Payload() const { return reinterpret_cast<const char*>(record + 1); }
+
+            Value Thaw(int depth) const
+            {
+                switch (GetType()) {
+                case ValueType::NUMBER: return Value(AsNumber());
+                case ValueType::BOOL: return Value(AsBool());
+                case ValueType::STRING: return Value(AsString());
+                case ValueType::ARRAY: {
+                    if (IsNumericArray()) return Value(std::vector<double>(AsNumbers().begin(), AsNumbers().end()));
+                    // Items only have to precede their array, so a broken image can chain them as deep as it is long
+                    if (depth >= BinaryFormat::MAX_VALUE_DEPTH) {
+                        std::cout << "Invalid frozen DCL image: arrays nested too deep\n";
+                        return Value();
+                    }
+                    std::vector<Value> items;
+                    for (size_t i = 0; i < ArraySize(); i++) items.push_back(ArrayAt(i).Thaw(depth + 1));
+                    return Value(std::move(items));
+                }
+                default: return Value();
+                }
+            }
+
+        public:
+            ValueView() = default;
+
+            ValueType GetType() const { return record ? static_cast<ValueType>(record->type) : ValueType::VOID; }
+
+            double AsNumber() const
+            {
+                if (GetType() != ValueType::NUMBER) return 0;
+                double result;
+                std::memcpy(&result, Payload(), sizeof(result));
+                return result;
+            }
+            bool AsBool() const { return GetType() == ValueType::BOOL && record->size != 0; }
+            // Points into the image
+            std::string_view AsString() const
+            {
+                return GetType() == ValueType::STRING ? std::string_view(Payload(), record->size) : std::string_view();
+            }
+
+            bool IsNumericArray() const { return GetType() == ValueType::ARRAY && (record->flags & BinaryFormat::VALUE_NUMERIC); }
+            size_t ArraySize() const { return GetType() == ValueType::ARRAY ? record->size : 0; }
+            // Numeric arrays only: straight over the image
+            std::span<const double> AsNumbers() const
+            {
+                if (!IsNumericArray()) return {};
+                return std::span<const double>(reinterpret_cast<const double*>(Payload()), record->size);
+            }
+            ValueView ArrayAt(size_t index) const
+            {
+                if (index >= ArraySize() || IsNumericArray()) return ValueView();
+                uint32_t offset;
+                std::memcpy(&offset, Payload() + index * sizeof(uint32_t), sizeof(offset));
+                // Items are placed before their array, anything else would allow cycles
+                const char* values = tree->data + tree->header->values_offset;
+                if (offset >= static_cast<uint64_t>(reinterpret_cast<const char*>(record) - values)) return ValueView();
+                return ValueView(tree, offset);
+            }
+
+            // Regular Value with a copy of the data. Arrays nested deeper than BinaryFormat::MAX_VALUE_DEPTH
+            // are reported as a broken image and thawed as VOID
+            Value Thaw() const { return Thaw(0); }
+            std::string ToString() const { return Thaw().ToString(); }
+        };
+
+        class FieldView
+        {
+            friend class FrozenTree;
+            friend class ContainerView;
+            const FrozenTree* tree = nullptr;
+            const BinaryFormat::FrozenField* record = nullptr;
+            uint32_t owner = 0;     // Index of the container of the field
+
+            FieldView(const FrozenTree* tree, const BinaryFormat::FrozenField* record, uint32_t owner) : tree(tree), record(record), owner(owner) {}
+
+        public:
+            FieldView() = default;
+            explicit operator bool() const { return record != nullptr; }
+
+            std::string_view GetName() const { return record ? tree->Name(record->name) : std::string_view(); }
+            bool IsKey() const { return record && record->is_key; }
+            bool IsContainer() const { return record && record->kind == BinaryFormat::KIND_CONTAINER; }
+            ContainerView GetContainer() const;
+            ValueView GetValue() const { return record && !IsContainer() ? ValueView(tree, record->payload) : ValueView(); }
+        };
+
+        class ContainerView
+        {
+            friend class FrozenTree;
+            const FrozenTree* tree;
+            const BinaryFormat::FrozenContainer* record;
+            uint32_t index;
+
+            ContainerView(const FrozenTree* tree, uint32_t index) : tree(tree), record(nullptr), index(index)
+            {
+                const Header& header = *tree->header;
+                if (index >= header.containers_count) return;
+                const auto* candidate = tree->Table<BinaryFormat::FrozenContainer>(header.containers_offset) + index;
+                if (candidate->first_field <= header.fields_count && candidate->fields_count <= header.fields_count - candidate->first_field)
+                    record = candidate;
+            }
+
+            const BinaryFormat::FrozenField* Fields() const
+            {
+                return tree->Table<BinaryFormat::FrozenField>(tree->header->fields_offset) + record->first_field;
+            }
+
+        public:
+            // Not in-class initializers: an empty view is a default argument inside FrozenTree
+            ContainerView() : tree(nullptr), record(nullptr), index(0) {}
+            explicit operator bool() const { return record != nullptr; }
+            bool operator==(const ContainerView& other) const { return record == other.record; }
+
+            std::string_view GetName() const { return record ? tree->Name(record->name) : std::string_view(); }
+            std::string_view GetTag() const { return record ? tree->Name(record->tag) : std::string_view(); }
+            Symbol GetTagSymbol() const { return record ? record->tag : SymbolTable::NO_SYMBOL; }
+
+            size_t FieldsCount() const { return record ? record->fields_count : 0; }
+            FieldView FieldAt(size_t slot) const
+            {
+                return slot < FieldsCount() ? FieldView(tree, Fields() + slot, index) : FieldView();
+            }
+            FieldView GetKey() const { return record ? FieldAt(record->key_slot) : FieldView(); }
+
+            // First declared field with the name which is (or isn't) a container: binary search in the sorted slots
+            FieldView FindField(Symbol name, bool is_container) const
+            {
+                if (!record || name == SymbolTable::NO_SYMBOL) return FieldView();
+                const uint32_t* order = tree->Table<uint32_t>(tree->header->field_order_offset) + record->first_field;
+                const uint32_t* end = order + record->fields_count;
+                std::string_view wanted = tree->Name(name);
+                const uint32_t* it = std::lower_bound(order, end, wanted, [&](uint32_t slot, std::string_view value) {
+                    return slot < record->fields_count && tree->Name(Fields()[slot].name) < value;
+                    });
+                for (; it != end && *it < record->fields_count && Fields()[*it].name == name; ++it) {
+                    const auto* field = Fields() + *it;
+                    if ((field->kind == BinaryFormat::KIND_CONTAINER) == is_container) return FieldView(tree, field, index);
+                }
+                return FieldView();
+            }
+            FieldView FindField(std::string_view name, bool is_container) const
+            {
+                return record ? FindField(tree->FindSymbol(name), is_container) : FieldView();
+            }
+            // First declared field with the name, container or not
+            FieldView FindField(std::string_view name) const
+            {
+                Symbol symbol = record ? tree->FindSymbol(name) : SymbolTable::NO_SYMBOL;
+                FieldView value = FindField(symbol, false);
+                FieldView container = FindField(symbol, true);
+                if (!value || !container) return value ? value : container;
+                return value.record < container.record ? value : container;
+            }
+        };
+
+        //Forbid copying: views point into the tree
+        FrozenTree(const FrozenTree&) = delete;
+        FrozenTree& operator=(const FrozenTree&) = delete;
+
+        // image must hold a frozen image and stay unchanged, nullptr if it doesn't
+        static std::shared_ptr<FrozenTree> FromBuffer(std::shared_ptr<SourceBuffer> image)
+        {
+            if constexpr (std::endian::native != std::endian::little) return nullptr;
+            if (!image) return nullptr;
+            std::shared_ptr<FrozenTree> tree(new FrozenTree(std::move(image)));
+            if (!tree->Validate()) {
+                std::cout << "Invalid frozen DCL image\n";
+                return nullptr;
+            }
+            return tree;
+        }
+
+        // The file is mapped, not read
+        static std::shared_ptr<FrozenTree> Open(const std::string& filename)
+        {
+            auto image = SourceBuffer::FromFile(filename);
+            if (!image) {
+                std::cout << "Failed to open: " << filename << "\n";
+                return nullptr;
+            }
+            return FromBuffer(std::move(image));
+        }
+
+        std::string_view Name(Symbol symbol) const
+        {
+            if (symbol >= header->symbols_count) return {};
+            return String(Table<BinaryFormat::FrozenString>(header->symbols_offset)[symbol]);
+        }
+
+        // NO_SYMBOL if nothing in the image has the name
+        Symbol FindSymbol(std::string_view name) const
+        {
+            const uint32_t* order = Table<uint32_t>(header->symbol_order_offset);
+            const uint32_t* end = order + header->symbols_count;
+            const uint32_t* it = std::lower_bound(order, end, name, [&](uint32_t symbol, std::string_view value) {
+                return Name(symbol) < value;
+                });
+            return it != end && Name(*it) == name ? *it : SymbolTable::NO_SYMBOL;
+        }
+
+        ContainerView GetRoot() const { return ContainerView(this, 0); }
+
+        // Same paths as ContainersTree::GetField: "Container::Field", "A::B::Field", "Container"
+        FieldView GetField(const std::string& absolute_path) const
+        {
+            auto path_parts = StringOperations::SplitString(absolute_path, "::");
+            if (path_parts.empty()) return FieldView();
+
+            FieldView current = GetRoot().FindField(path_parts[0], true);
+            for (size_t i = 1; current && i < path_parts.size(); i++) {
+                current = current.GetContainer().FindField(path_parts[i], i + 1 < path_parts.size());
+            }
+            return current;
+        }
+
+        // Same as ContainersTree::GetByTag: containers with the tag among the fields of where (the root by default),
+        // deep adds their descendants with the same tag, breadth-first
+        std::vector<ContainerView> GetByTag(std::string_view tag_value, ContainerView where = ContainerView(), bool deep = false) const
+        {
+            std::vector<ContainerView> containers;
+            if (!where) where = GetRoot();
+            Symbol tag = FindSymbol(tag_value);
+            if (tag == SymbolTable::NO_SYMBOL) return containers;
+
+            std::queue<ContainerView> queue;
+            auto push_children = [&](const ContainerView& container) {
+                for (size_t i = 0; i < container.FieldsCount(); i++) {
+                    FieldView field = container.FieldAt(i);
+                    if (!field.IsContainer()) continue;
+                    ContainerView child = field.GetContainer();
+                    if (child && child.GetTagSymbol() == tag) queue.push(child);
+                }
+            };
+            push_children(where);
+            while (!queue.empty()) {
+                ContainerView container = queue.front();
+                queue.pop();
+                containers.push_back(container);
+                if (deep) push_children(container);
+            }
+            return containers;
+        }
+
+        ContainerView FindByKey(std::string_view key_value) const
+        {
+            const auto* keys = Table<BinaryFormat::FrozenKey>(header->keys_offset);
+            const auto* end = keys + header->keys_count;
+            const auto* it = std::lower_bound(keys, end, key_value, [&](const BinaryFormat::FrozenKey& key, std::string_view value) {
+                return String(key.key) < value;
+                });
+            return it != end && String(it->key) == key_value ? ContainerView(this, it->container) : ContainerView();
+        }
+    };
+
+    // Children follow their parents in the image: anything else is broken and would allow cycles
+    inline FrozenTree::ContainerView FrozenTree::FieldView::GetContainer() const
+    {
+        return IsContainer() && record->payload > owner ? ContainerView(tree, record->payload) : ContainerView();
+    }
+}
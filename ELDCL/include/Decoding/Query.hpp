@@ -0,0 +1,404 @@
+#pragma once
+#include "ContainersTree.hpp"
+
+
+namespace DCL
+{
+    // Lazy query over a tree: a source of containers, then filters and steps down to children, then a projection.
+    //
+    //   Query(tree).Tag("entity").Where("ID", Query::GREATER, 100).Children("component").Select({ "Origin" })
+    //
+    // Nothing is evaluated until iteration, and then one container at a time: stages pull from the previous
+    // one, no intermediate vectors are made. A Tag source reads the tag index of the tree; when the first
+    // filter compares a field which has an index (ContainersTree::CreateIndex), the matching containers
+    // come straight from that index instead (ascending by value for ranges, breadth-first otherwise).
+    class Query
+    {
+    public:
+        enum Compare { EQUAL, NOT_EQUAL, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL };
+
+        struct Row
+        {
+            std::shared_ptr<Container> container;
+            std::vector<Field*> fields;     // Select()ed fields in the given order, nullptr where missing
+        };
+
+    private:
+        enum class SourceKind { ALL, TAG, PATH };
+        enum class StageKind { COMPARE, PREDICATE, CHILDREN };
+
+        struct Stage
+        {
+            StageKind kind = StageKind::COMPARE;
+            std::string name{};         // Field to compare or tag of the children (empty - any)
+            Compare compare = EQUAL;
+            Value value{};
+            std::function<bool(const Container&)> predicate{};
+        };
+
+        // What the builders describe. Cursors share it, so an iteration doesn't depend on the Query living
+        struct Plan
+        {
+            std::shared_ptr<ContainersTree> tree;
+            SourceKind source = SourceKind::ALL;
+            std::string source_text;        // Tag or path glob
+            std::vector<Stage> stages;
+            std::vector<std::string> projection;
+        };
+
+        std::shared_ptr<Plan> plan;
+
+        // Plan no cursor shares: iterations which already started keep the one they started with
+        Plan& Edit()
+        {
+            if (plan.use_count() > 1) plan = std::make_shared<Plan>(*plan);
+            return *plan;
+        }
+
+        // '*' - any run of chars, '?' - one char
+        static bool MatchGlob(std::string_view pattern, std::string_view text)
+        {
+            size_t p = 0, t = 0, star = std::string_view::npos, retry = 0;
+            while (t < text.size()) {
+                if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) { p++; t++; }
+                else if (p < pattern.size() && pattern[p] == '*') { star = p++; retry = t; }
+                else if (star != std::string_view::npos) { p = star + 1; t = ++retry; }
+                else return false;
+            }
+            while (p < pattern.size() && pattern[p] == '*') p++;
+            return p == pattern.size();
+        }
+
+        static bool Matches(const Value& field, Compare compare, const Value& value)
+        {
+            int order;
+            if (field.type == ValueType::NUMBER && value.type == ValueType::NUMBER) {
+                double a = field.AsNumber(), b = value.AsNumber();
+                order = a < b ? -1 : (a > b ? 1 : 0);
+            }
+            else if (field.type == ValueType::STRING && value.type == ValueType::STRING) {
+                int result = field.AsString().compare(value.AsString());
+                order = result < 0 ? -1 : (result > 0 ? 1 : 0);
+            }
+            else {
+                // Different types are only equal or not, as in the key index
+                bool equal = field.type != ValueType::VOID && field.ToString() == value.ToString();
+                if (compare == EQUAL) return equal;
+                if (compare == NOT_EQUAL) return !equal;
+                return false;
+            }
+            switch (compare) {
+            case EQUAL: return order == 0;
+            case NOT_EQUAL: return order != 0;
+            case LESS: return order < 0;
+            case LESS_EQUAL: return order <= 0;
+            case GREATER: return order > 0;
+            case GREATER_EQUAL: return order >= 0;
+            }
+            return false;
+        }
+
+        // State of one iteration: every stage pulls the next container from the one before it
+        class Cursor
+        {
+            struct StageState
+            {
+                const Stage* stage = nullptr;
+                Symbol symbol = SymbolTable::NO_SYMBOL;
+                std::shared_ptr<Container> parent{};    // CHILDREN: container being expanded
+                size_t slot = 0;
+            };
+
+            std::shared_ptr<const Plan> query;
+            std::shared_ptr<const TreeIndex> index;     // Keeps the snapshot alive while it's read
+            std::vector<StageState> states;
+            std::vector<Symbol> projection;
+            bool empty = false;
+
+            // Source: a list of the index, or a walk of the tree
+            const TreeIndex::Containers* list = nullptr;
+            const std::vector<std::pair<double, std::shared_ptr<Container>>>* numbers = nullptr;
+            size_t position = 0, numbers_end = 0;
+            Symbol source_tag = SymbolTable::NO_SYMBOL;
+            std::vector<std::string_view> path_globs;     // PATH: glob per level
+            struct Frame { Container* container; size_t slot; size_t depth; };
+            std::vector<Frame> walk;
+
+            void PlanIndexedSource(const ContainersTree& tree)
+            {
+                if (query->stages.empty() || query->stages[0].kind != StageKind::COMPARE) return;
+                const Stage& first = query->stages[0];
+                Symbol field = tree.GetSymbols().Find(first.name);
+                if (field == SymbolTable::NO_SYMBOL) return;
+
+                if (first.compare == EQUAL) {
+                    const auto* field_index = index->FindIndex(field);
+                    if (!field_index) return;
+                    auto it = field_index->by_value.find(first.value.ToString());
+                    static const TreeIndex::Containers none;
+                    list = it != field_index->by_value.end() ? &it->second : &none;
+                    position = 0;
+                    return;
+                }
+                if (first.compare == NOT_EQUAL || first.value.type != ValueType::NUMBER) return;
+                const auto* field_index = index->FindIndex(field, true);
+                if (!field_index) return;
+                const auto& entries = field_index->by_number;
+                double bound = first.value.AsNumber();
+                auto lower = [&](double value) { return std::lower_bound(entries.begin(), entries.end(), value, [](const auto& e, double v) { return e.first < v; }); };
+                auto upper = [&](double value) { return std::upper_bound(entries.begin(), entries.end(), value, [](double v, const auto& e) { return v < e.first; }); };
+                auto begin = entries.begin(), end = entries.end();
+                if (first.compare == LESS) end = lower(bound);
+                else if (first.compare == LESS_EQUAL) end = upper(bound);
+                else if (first.compare == GREATER) begin = upper(bound);
+                else begin = lower(bound);
+                numbers = &entries;
+                position = begin - entries.begin();
+                numbers_end = end - entries.begin();
+                list = nullptr;
+            }
+
+            bool NextFromSource(std::shared_ptr<Container>& out)
+            {
+                if (numbers) {
+                    while (position < numbers_end) {
+                        const auto& container = (*numbers)[position++].second;
+                        if (query->source != SourceKind::TAG || container->tag == source_tag) {
+                            out = container;
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+                if (list) {
+                    while (position < list->size()) {
+                        const auto& container = (*list)[position++];
+                        if (query->source != SourceKind::TAG || container->tag == source_tag) {
+                            out = container;
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+                // Depth-first walk, containers come in declaration order
+                while (!walk.empty()) {
+                    Frame& frame = walk.back();
+                    if (frame.slot >= frame.container->ordered_fields.size()) {
+                        walk.pop_back();
+                        continue;
+                    }
+                    Field& field = frame.container->ordered_fields[frame.slot++];
+                    if (!field.isContainer || !field.container) continue;
+                    size_t depth = frame.depth;
+                    if (query->source == SourceKind::PATH) {
+                        if (!MatchGlob(path_globs[depth], field.container->GetName())) continue;
+                        if (depth + 1 < path_globs.size()) {
+                            walk.push_back({ field.container.get(), 0, depth + 1 });
+                            continue;
+                        }
+                    }
+                    else {
+                        walk.push_back({ field.container.get(), 0, depth + 1 });
+                    }
+                    out = field.container;
+                    return true;
+                }
+                return false;
+            }
+
+            bool Pull(size_t stage, std::shared_ptr<Container>& out)
+            {
+                if (stage == 0) return NextFromSource(out);
+                StageState& state = states[stage - 1];
+                const Stage& description = *state.stage;
+                switch (description.kind) {
+                case StageKind::COMPARE:
+                    while (Pull(stage - 1, out)) {
+                        Field* field = out->FindField(state.symbol, false);
+                        if (field && Matches(field->value, description.compare, description.value)) return true;
+                    }
+                    return false;
+                case StageKind::PREDICATE:
+                    while (Pull(stage - 1, out)) {
+                        if (description.predicate(*out)) return true;
+                    }
+                    return false;
+                case StageKind::CHILDREN:
+                    while (true) {
+                        if (state.parent) {
+                            auto& fields = state.parent->ordered_fields;
+                            while (state.slot < fields.size()) {
+                                Field& field = fields[state.slot++];
+                                if (field.isContainer && field.container &&
+                                    (description.name.empty() || field.container->tag == state.symbol)) {
+                                    out = field.container;
+                                    return true;
+                                }
+                            }
+                        }
+                        if (!Pull(stage - 1, state.parent)) return false;
+                        state.slot = 0;
+                    }
+                }
+                return false;
+            }
+
+        public:
+            explicit Cursor(std::shared_ptr<const Plan> plan) : query(std::move(plan))
+            {
+                const ContainersTree& tree = *query->tree;
+                const SymbolTable& symbols = tree.GetSymbols();
+                index = tree.GetIndex();
+
+                for (const auto& stage : query->stages) {
+                    StageState state{ &stage };
+                    if (stage.kind != StageKind::PREDICATE) {
+                        state.symbol = symbols.Find(stage.name);
+                        // A name the tree doesn't have matches nothing (an empty CHILDREN tag matches any)
+                        if (state.symbol == SymbolTable::NO_SYMBOL && !(stage.kind == StageKind::CHILDREN && stage.name.empty())) empty = true;
+                    }
+                    states.push_back(std::move(state));
+                }
+                for (const auto& name : query->projection) projection.push_back(symbols.Find(name));
+
+                Container* root = tree.GetRoot().get();
+                if (query->source == SourceKind::TAG) {
+                    source_tag = symbols.Find(query->source_text);
+                    if (source_tag == SymbolTable::NO_SYMBOL) empty = true;
+                    list = &index->ByTag(source_tag);
+                }
+                else if (query->source == SourceKind::PATH) {
+                    std::string_view text = query->source_text;
+                    for (size_t start = 0; start < text.size();) {
+                        size_t end = std::min(text.find("::", start), text.size());
+                        path_globs.push_back(text.substr(start, end - start));
+                        start = end + 2;
+                    }
+                    if (path_globs.empty()) empty = true;
+                    walk.push_back({ root, 0, 0 });
+                }
+                else {
+                    walk.push_back({ root, 0, 0 });
+                }
+                if (query->source != SourceKind::PATH) PlanIndexedSource(tree);
+            }
+
+            bool Next(Row& row)
+            {
+                if (empty || !Pull(states.size(), row.container)) return false;
+                row.fields.clear();
+                for (Symbol name : projection) row.fields.push_back(row.container->FindField(name));
+                return true;
+            }
+        };
+
+    public:
+        class Iterator
+        {
+            std::shared_ptr<Cursor> cursor;
+            Row row;
+
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = Row;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Row*;
+            using reference = const Row&;
+
+            Iterator() = default;
+            explicit Iterator(std::shared_ptr<Cursor> cursor) : cursor(std::move(cursor)) { ++*this; }
+
+            const Row& operator*() const { return row; }
+            const Row* operator->() const { return &row; }
+            Iterator& operator++()
+            {
+                if (cursor && !cursor->Next(row)) cursor.reset();
+                return *this;
+            }
+            bool operator==(const Iterator& other) const { return cursor == other.cursor; }
+            bool operator!=(const Iterator& other) const { return cursor != other.cursor; }
+        };
+
+        explicit Query(std::shared_ptr<ContainersTree> tree) : plan(std::make_shared<Plan>())
+        {
+            plan->tree = std::move(tree);
+        }
+
+        // Builders of a temporary Query return it by value, so a range-for over a chain of them keeps it alive
+
+        // === SOURCES (the last one wins) ===
+
+        // Every container with the tag, at any depth, breadth-first
+        Query& Tag(std::string tag) &
+        {
+            Plan& edit = Edit();
+            edit.source = SourceKind::TAG;
+            edit.source_text = std::move(tag);
+            return *this;
+        }
+        Query Tag(std::string tag) && { Tag(std::move(tag)); return std::move(*this); }
+
+        // Containers by names from the root: "Entity1*::Transform", '*' and '?' in every part
+        Query& Path(std::string glob) &
+        {
+            Plan& edit = Edit();
+            edit.source = SourceKind::PATH;
+            edit.source_text = std::move(glob);
+            return *this;
+        }
+        Query Path(std::string glob) && { Path(std::move(glob)); return std::move(*this); }
+
+        // === STAGES (in order) ===
+
+        Query& Where(std::string field, Compare compare, Value value) &
+        {
+            Edit().stages.push_back({ StageKind::COMPARE, std::move(field), compare, std::move(value) });
+            return *this;
+        }
+        Query Where(std::string field, Compare compare, Value value) &&
+        {
+            Where(std::move(field), compare, std::move(value));
+            return std::move(*this);
+        }
+        Query& Where(std::function<bool(const Container&)> predicate) &
+        {
+            Edit().stages.push_back({ StageKind::PREDICATE, "", EQUAL, Value(), std::move(predicate) });
+            return *this;
+        }
+        Query Where(std::function<bool(const Container&)> predicate) && { Where(std::move(predicate)); return std::move(*this); }
+
+        // Replaces every container with its child containers with the tag (any tag if empty)
+        Query& Children(std::string tag = "") &
+        {
+            Edit().stages.push_back({ StageKind::CHILDREN, std::move(tag) });
+            return *this;
+        }
+        Query Children(std::string tag = "") && { Children(std::move(tag)); return std::move(*this); }
+
+        // Fields put into Row::fields
+        Query& Select(std::vector<std::string> fields) &
+        {
+            Edit().projection = std::move(fields);
+            return *this;
+        }
+        Query Select(std::vector<std::string> fields) && { Select(std::move(fields)); return std::move(*this); }
+
+        // Every begin() evaluates the query again. The tree must not change during an iteration
+        Iterator begin() const { return Iterator(std::make_shared<Cursor>(plan)); }
+        Iterator end() const { return Iterator(); }
+
+        size_t Count() const
+        {
+            size_t count = 0;
+            for (auto it = begin(); it != end(); ++it) count++;
+            return count;
+        }
+
+        std::vector<std::shared_ptr<Container>> ToVector() const
+        {
+            std::vector<std::shared_ptr<Container>> containers;
+            for (const Row& row : *this) containers.push_back(row.container);
+            return containers;
+        }
+    };
+}
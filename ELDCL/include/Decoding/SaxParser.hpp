@@ -0,0 +1,162 @@
+#pragma once
+#include "..\Tokenization\Lexer.hpp"
+#include <span>
+
+
+namespace DCL
+{
+    // Events of SaxParser. Values come as raw tokens: nothing is parsed or resolved,
+    // copy statements are reported as they are written.
+    // Token values are spans over the source and are valid only during the call
+    class SaxHandler
+    {
+    public:
+        virtual ~SaxHandler() = default;
+
+        // false skips the container with everything inside it, OnContainerEnd isn't called for it either
+        virtual bool OnContainerBegin(std::string_view /*tag*/, std::string_view /*name*/) { return true; }
+        virtual void OnField(std::string_view /*name*/, std::span<const Token> /*value*/, bool /*is_key*/) {}
+        virtual void OnCopy(std::string_view /*source_name*/) {}
+        virtual void OnContainerEnd() {}
+    };
+
+    // Walks a source straight off Lexer::Next without building a tree: only the tokens of the current
+    // statement are kept, so memory doesn't depend on the size of the input
+    class SaxParser
+    {
+        SaxHandler& handler;
+        SourceBuffer& source;
+        std::vector<Token> statement;   // Reused for every statement
+        std::deque<std::string> literals;   // Escaped literals of the statement, the source's own store isn't touched
+        size_t depth = 0;               // Open containers, skipped ones included
+        size_t skip_depth = 0;          // depth of the container being skipped, 0 if none
+
+        static bool IsContainerHeader(std::span<const Token> header)
+        {
+            for (size_t i = 0; i + 1 < header.size(); i++) {
+                if (header[i].value == "tag" && header[i + 1].value == "::") return true;
+            }
+            return false;
+        }
+
+        // Same rules as the decoder: "tag::x Name", defaults for what is missing
+        static void ParseContainerHeader(std::span<const Token> header, std::string_view& tag, std::string_view& name)
+        {
+            tag = "container";
+            name = "container0";
+            bool has_name = false;
+            for (size_t i = 0; i < header.size(); i++) {
+                if (header[i].value == "tag" && i + 2 < header.size() && header[i + 1].value == "::") {
+                    tag = header[i + 2].value;
+                    i += 2;
+                }
+                else if (header[i].type == TokenType::IDENTIFIER && !has_name) {
+                    name = header[i].value;
+                    has_name = true;
+                }
+            }
+        }
+
+        void OpenContainer()
+        {
+            depth++;
+            if (skip_depth != 0) return;
+            std::string_view tag, name;
+            ParseContainerHeader(statement, tag, name);
+            if (!handler.OnContainerBegin(tag, name)) skip_depth = depth;
+        }
+
+        void CloseContainer()
+        {
+            if (depth == 0) return;
+            if (skip_depth == 0) handler.OnContainerEnd();
+            else if (skip_depth == depth) skip_depth = 0;
+            depth--;
+        }
+
+        void EmitStatement()
+        {
+            if (skip_depth != 0 || statement.empty()) return;
+            std::span<const Token> tokens(statement);
+
+            if (tokens[0].value == "copy" && tokens.size() > 1) {
+                handler.OnCopy(tokens[1].value);
+                return;
+            }
+            if (tokens[0].value == "key") {
+                if (tokens.size() < 3) return;
+                handler.OnField(tokens[1].value, tokens.subspan(3), true);
+                return;
+            }
+            for (size_t i = 1; i < tokens.size(); i++) {
+                if (tokens[i].value == ":" && tokens[i - 1].type == TokenType::IDENTIFIER) {
+                    handler.OnField(tokens[i - 1].value, tokens.subspan(i + 1), false);
+                    return;
+                }
+            }
+        }
+
+        // Tokens of the statement are gone, so are the literals materialized for them
+        void NextStatement()
+        {
+            statement.clear();
+            literals.clear();
+        }
+
+        SaxParser(SourceBuffer& source, SaxHandler& handler) : handler(handler), source(source) {}
+
+        void Run()
+        {
+            Lexer::Cursor cursor = Lexer::Begin(source);
+            cursor.literals = &literals;
+            Token t;
+            while (Lexer::Next(cursor, t)) {
+                if (t.type == TokenType::DELIMITER && t.value == "{") {
+                    OpenContainer();   // Заголовок блока (до {)
+                    NextStatement();
+                    continue;
+                }
+                if (t.type == TokenType::DELIMITER && t.value == "}") {
+                    EmitStatement();   // Последняя строка без ;
+                    CloseContainer();
+                    NextStatement();
+                    continue;
+                }
+                if (t.type == TokenType::END) {
+                    // "tag::x Name;" declares an empty container
+                    if (IsContainerHeader(statement)) {
+                        OpenContainer();
+                        CloseContainer();
+                    }
+                    else {
+                        EmitStatement();
+                    }
+                    NextStatement();
+                    continue;
+                }
+                if (skip_depth == 0) statement.push_back(t);
+            }
+            EmitStatement();
+            NextStatement();
+        }
+
+    public:
+        static void Parse(SourceBuffer& source, SaxHandler& handler)
+        {
+            SaxParser parser(source, handler);
+            parser.Run();
+        }
+
+        // The file is mapped, not read into memory. false if it can't be opened
+        static bool ParseFile(const std::string& filename, SaxHandler& handler)
+        {
+            auto source = SourceBuffer::FromFile(filename);
+            if (!source) {
+                std::cout << "Failed to open: " << filename << "\n";
+                return false;
+            }
+            Parse(*source, handler);
+            return true;
+        }
+    };
+}
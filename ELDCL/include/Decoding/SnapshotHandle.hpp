@@ -0,0 +1,130 @@
+#pragma once
+#include "ContainersTree.hpp"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+
+namespace DCL
+{
+    // The current tree for many reader threads while another thread publishes new ones, RCU style:
+    //  - a reader marks itself in the counter of the current parity in its slot (slots are cache lines, threads
+    //    are spread over them), loads the snapshot and unmarks itself when the guard goes: no locks, no loops
+    //  - Publish swaps the snapshot, then waits for two grace periods: it flips the parity and waits until the
+    //    counters of the old one drain, twice, so no reader can still hold the old snapshot. Then it's released
+    // Published trees are snapshots: they are read, never changed. A tree published here must never be reloaded
+    // in place: give HotReloader SetSnapshotMode and publish the tree of every ReloadResult instead.
+    // A thread must not Publish while it holds a ReadGuard of the same handle: it would wait for itself
+    class SnapshotHandle
+    {
+        struct Snapshot
+        {
+            std::shared_ptr<ContainersTree> tree;
+        };
+
+        struct alignas(64) Slot
+        {
+            std::atomic<uint32_t> readers[2] = { 0, 0 };
+        };
+
+        static constexpr size_t SLOTS = 64;
+
+        std::atomic<Snapshot*> current = nullptr;
+        std::atomic<uint64_t> epoch = 0;        // New readers mark the counters of its parity
+        Slot slots[SLOTS];
+        std::mutex writer_mutex;                // One publisher at a time
+
+        static size_t ThisThreadSlot()
+        {
+            static std::atomic<size_t> next = 0;
+            thread_local size_t slot = next.fetch_add(1, std::memory_order_relaxed) % SLOTS;
+            return slot;
+        }
+
+        // Readers which read the old parity before the flip either marked it already, and are waited for here,
+        // or mark it later and then load the new snapshot
+        void Synchronize()
+        {
+            for (int round = 0; round < 2; round++) {
+                size_t parity = epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+                for (auto& slot : slots) {
+                    while (slot.readers[parity].load(std::memory_order_seq_cst) != 0) std::this_thread::yield();
+                }
+            }
+        }
+
+    public:
+        // The snapshot current when Read was called, valid while the guard lives. Not shared between threads
+        class ReadGuard
+        {
+            friend class SnapshotHandle;
+
+            std::atomic<uint32_t>* counter = nullptr;
+            Snapshot* snapshot = nullptr;
+
+            explicit ReadGuard(SnapshotHandle& handle)
+            {
+                Slot& slot = handle.slots[ThisThreadSlot()];
+                counter = &slot.readers[handle.epoch.load(std::memory_order_seq_cst) & 1];
+                counter->fetch_add(1, std::memory_order_seq_cst);
+                snapshot = handle.current.load(std::memory_order_seq_cst);
+            }
+
+        public:
+            ReadGuard(ReadGuard&& other) noexcept
+                : counter(std::exchange(other.counter, nullptr)), snapshot(std::exchange(other.snapshot, nullptr)) {}
+            ReadGuard& operator=(ReadGuard&& other) noexcept
+            {
+                if (this != &other) {
+                    if (counter) counter->fetch_sub(1, std::memory_order_release);
+                    counter = std::exchange(other.counter, nullptr);
+                    snapshot = std::exchange(other.snapshot, nullptr);
+                }
+                return *this;
+            }
+            //Forbid copying
+            ReadGuard(const ReadGuard&) = delete;
+            ReadGuard& operator=(const ReadGuard&) = delete;
+
+            ~ReadGuard()
+            {
+                if (counter) counter->fetch_sub(1, std::memory_order_release);
+            }
+
+            // nullptr before the first Publish
+            ContainersTree* Get() const { return snapshot ? snapshot->tree.get() : nullptr; }
+            ContainersTree* operator->() const { return Get(); }
+            ContainersTree& operator*() const { return *Get(); }
+            explicit operator bool() const { return Get() != nullptr; }
+
+            // Keeps the snapshot after the guard is gone (a reference count, not wait-free like the guard)
+            std::shared_ptr<ContainersTree> Retain() const { return snapshot ? snapshot->tree : nullptr; }
+        };
+
+        SnapshotHandle() = default;
+        explicit SnapshotHandle(std::shared_ptr<ContainersTree> tree) { Publish(std::move(tree)); }
+
+        //Forbid copying: guards point into the slots
+        SnapshotHandle(const SnapshotHandle&) = delete;
+        SnapshotHandle& operator=(const SnapshotHandle&) = delete;
+
+        // No guard may outlive the handle
+        ~SnapshotHandle()
+        {
+            delete current.load(std::memory_order_acquire);
+        }
+
+        ReadGuard Read() { return ReadGuard(*this); }
+
+        // Makes tree the current snapshot. Returns once no reader holds the previous one, which is released then
+        // (the tree itself lives on while someone has Retain-ed it)
+        void Publish(std::shared_ptr<ContainersTree> tree)
+        {
+            std::lock_guard lock(writer_mutex);
+            Snapshot* old = current.exchange(new Snapshot{ std::move(tree) }, std::memory_order_seq_cst);
+            if (!old) return;
+            Synchronize();
+            delete old;
+        }
+    };
+}
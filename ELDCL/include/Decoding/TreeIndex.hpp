@@ -0,0 +1,97 @@
+#pragma once
+#include "..\Definitions\Types.hpp"
+#include <algorithm>
+
+
+namespace DCL
+{
+    // Indexes of one ContainersTree, built in one breadth-first pass and never changed afterwards:
+    // the tree builds a new one when its generation changes, readers keep the old one while they use it.
+    //  - tags: containers of every tag in breadth-first order, with the parent links that's enough for GetByTag
+    //  - field indexes declared by ContainersTree::CreateIndex: containers by the value of their field,
+    //    ordered ones also keep the numeric values sorted for range queries
+    class TreeIndex
+    {
+    public:
+        struct Definition
+        {
+            Symbol field = SymbolTable::NO_SYMBOL;
+            bool ordered = false;
+        };
+
+        using Containers = std::vector<std::shared_ptr<Container>>;
+
+        struct FieldIndex
+        {
+            Definition definition{};
+            std::unordered_map<std::string, Containers> by_value{};        // Value::ToString, as in the key index
+            std::vector<std::pair<double, std::shared_ptr<Container>>> by_number{};     // Ordered indexes only, sorted
+        };
+
+    private:
+        uint64_t generation = 0;
+        std::unordered_map<Symbol, Containers> by_tag;
+        std::vector<FieldIndex> fields;
+
+        static const Containers& Empty()
+        {
+            static const Containers empty;
+            return empty;
+        }
+
+    public:
+        static std::shared_ptr<const TreeIndex> Build(const std::shared_ptr<Container>& root,
+            const std::vector<Definition>& definitions, uint64_t generation)
+        {
+            auto index = std::make_shared<TreeIndex>();
+            index->generation = generation;
+            for (const auto& definition : definitions) index->fields.push_back({ definition });
+
+            // The result vector is the queue of the walk
+            Containers order = { root };
+            for (size_t i = 0; i < order.size(); i++) {
+                Container& container = *order[i];
+                for (auto& field : container.ordered_fields) {
+                    if (field.isContainer && field.container) {
+                        order.push_back(field.container);
+                        index->by_tag[field.container->tag].push_back(field.container);
+                    }
+                }
+                if (i == 0) continue;   // The root has no fields of its own for the indexes
+                for (auto& field_index : index->fields) {
+                    Field* field = container.FindField(field_index.definition.field, false);
+                    if (!field || field->value.type == ValueType::VOID) continue;
+                    field_index.by_value[field->value.ToString()].push_back(order[i]);
+                    if (field_index.definition.ordered && field->value.type == ValueType::NUMBER)
+                        field_index.by_number.emplace_back(field->value.AsNumber(), order[i]);
+                }
+            }
+            for (auto& field_index : index->fields) {
+                // Stable: equal numbers keep the breadth-first order
+                std::stable_sort(field_index.by_number.begin(), field_index.by_number.end(),
+                    [](const auto& a, const auto& b) { return a.first < b.first; });
+            }
+            return index;
+        }
+
+        uint64_t GetGeneration() const { return generation; }
+
+        // All containers with the tag, breadth-first
+        const Containers& ByTag(Symbol tag) const
+        {
+            auto it = by_tag.find(tag);
+            return it != by_tag.end() ? it->second : Empty();
+        }
+
+        // nullptr if there is no index on the field (or not an ordered one, when ordered is asked for)
+        const FieldIndex* FindIndex(Symbol field, bool ordered = false) const
+        {
+            for (const auto& field_index : fields) {
+                if (field_index.definition.field == field && (!ordered || field_index.definition.ordered)) return &field_index;
+            }
+            return nullptr;
+        }
+
+        const std::vector<FieldIndex>& GetFieldIndexes() const { return fields; }
+    };
+}
@@ -4,6 +4,7 @@
 #include <vector>
 #include <iostream>
 #include <filesystem>
+#include <atomic>
 
 namespace DCL
 {
@@ -112,8 +113,8 @@ namespace DCL
         }
 
         static std::string GenerateLabel(const std::string& base) {
-            static int counter = 0;
-            return base + "_" + std::to_string(counter++);
+            static std::atomic<int> counter = 0;    // Labels stay unique when several threads generate them
+            return base + "_" + std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
         }
 
         static std::string ConcatPaths(const std::string& str1, const std::string& str2) {
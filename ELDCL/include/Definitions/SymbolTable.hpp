@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <cstdint>
+
+
+namespace DCL
+{
+    using Symbol = uint32_t;
+
+    // Interned names of one tree: field, container and tag names are stored once and compared as integers.
+    // Lookups take a shared lock, so a table can be shared by decoders running in parallel.
+    class SymbolTable
+    {
+        mutable std::shared_mutex mutex;
+        std::deque<std::string> names;                      // deque keeps the strings (and views on them) in place
+        std::unordered_map<std::string_view, Symbol> ids;
+
+    public:
+        static constexpr Symbol NO_SYMBOL = 0xFFFFFFFF;
+        // Preinterned in every table
+        static constexpr Symbol DEFAULT_TAG = 0;            // "container"
+        static constexpr Symbol DEFAULT_NAME = 1;           // "container0"
+        static constexpr Symbol ROOT = 2;                   // "root"
+
+        SymbolTable()
+        {
+            Intern("container");
+            Intern("container0");
+            Intern("root");
+        }
+        //Forbid copying: views in ids point into names
+        SymbolTable(const SymbolTable&) = delete;
+        SymbolTable& operator=(const SymbolTable&) = delete;
+
+        Symbol Intern(std::string_view name)
+        {
+            {
+                std::shared_lock lock(mutex);
+                auto it = ids.find(name);
+                if (it != ids.end()) return it->second;
+            }
+            std::unique_lock lock(mutex);
+            auto it = ids.find(name);
+            if (it != ids.end()) return it->second;
+
+            Symbol symbol = static_cast<Symbol>(names.size());
+            names.emplace_back(name);
+            ids.emplace(names.back(), symbol);
+            return symbol;
+        }
+
+        // NO_SYMBOL if the name was never interned, so nothing in the tree can have it
+        Symbol Find(std::string_view name) const
+        {
+            std::shared_lock lock(mutex);
+            auto it = ids.find(name);
+            return it != ids.end() ? it->second : NO_SYMBOL;
+        }
+
+        const std::string& Name(Symbol symbol) const
+        {
+            static const std::string empty;
+            std::shared_lock lock(mutex);
+            return symbol < names.size() ? names[symbol] : empty;
+        }
+
+        size_t Size() const
+        {
+            std::shared_lock lock(mutex);
+            return names.size();
+        }
+    };
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+
+namespace DCL
+{
+    // Counts the tasks of one batch, so independent callers can share a pool and wait only for their own work
+    class TaskGroup
+    {
+        friend class ThreadPool;
+
+        std::atomic<size_t> pending = 0;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;   // First exception thrown by a task, under the mutex
+
+        void Fail(std::exception_ptr exception)
+        {
+            std::lock_guard lock(mutex);
+            if (!error) error = std::move(exception);
+        }
+
+        // Under the mutex, so a waiter which saw zero can't destroy the group while we still touch it
+        void Finish()
+        {
+            std::lock_guard lock(mutex);
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) done.notify_all();
+        }
+    };
+
+    // Work-stealing pool: every worker has its own deque, takes work from the back of it
+    // and steals from the front of the others when it runs dry
+    class ThreadPool
+    {
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread> threads;
+        std::atomic<size_t> next_worker = 0;
+        std::atomic<size_t> queued = 0;
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+
+        bool TryPop(size_t self, std::function<void()>& task)
+        {
+            {
+                Worker& own = *workers[self];
+                std::lock_guard lock(own.mutex);
+                if (!own.tasks.empty()) {
+                    task = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    queued.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < workers.size(); i++) {
+                Worker& victim = *workers[(self + i) % workers.size()];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    queued.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void WorkerLoop(size_t self)
+        {
+            std::function<void()> task;
+            while (true) {
+                if (TryPop(self, task)) {
+                    task();
+                    task = nullptr;
+                    continue;
+                }
+                std::unique_lock lock(sleep_mutex);
+                wake.wait(lock, [this]() { return stopping || queued.load(std::memory_order_relaxed) > 0; });
+                if (stopping && queued.load(std::memory_order_relaxed) == 0) return;
+            }
+        }
+
+    public:
+        explicit ThreadPool(size_t threads_count = 0)
+        {
+            if (threads_count == 0) threads_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+            for (size_t i = 0; i < threads_count; i++) workers.push_back(std::make_unique<Worker>());
+            for (size_t i = 0; i < threads_count; i++) threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+        }
+
+        //Forbid copying
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard lock(sleep_mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& thread : threads) thread.join();
+        }
+
+        // Pool shared by the decoders and loaders of the process
+        static ThreadPool& Get()
+        {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        size_t GetThreadsCount() const { return threads.size(); }
+
+        void Run(TaskGroup& group, std::function<void()> task)
+        {
+            group.pending.fetch_add(1, std::memory_order_relaxed);
+            Worker& worker = *workers[next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+            {
+                std::lock_guard lock(worker.mutex);
+                queued.fetch_add(1, std::memory_order_relaxed);
+                worker.tasks.push_back([&group, task = std::move(task)]() {
+                    // An exception mustn't leave the worker (terminate) or skip Finish (Wait would hang)
+                    try {
+                        task();
+                    }
+                    catch (...) {
+                        group.Fail(std::current_exception());
+                    }
+                    group.Finish();
+                    });
+            }
+            {
+                std::lock_guard lock(sleep_mutex);
+            }
+            wake.notify_one();
+        }
+
+        // Waits for the tasks of group, running queued tasks meanwhile (so it's safe to call from a worker).
+        // Then rethrows the first exception of the tasks, if any threw: the others still ran to the end
+        void Wait(TaskGroup& group)
+        {
+            std::function<void()> task;
+            size_t self = next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+            while (group.pending.load(std::memory_order_acquire) > 0) {
+                if (TryPop(self, task)) {
+                    task();
+                    task = nullptr;
+                    continue;
+                }
+                std::unique_lock lock(group.mutex);
+                group.done.wait_for(lock, std::chrono::milliseconds(1), [&group]() {
+                    return group.pending.load(std::memory_order_acquire) == 0;
+                    });
+            }
+            std::exception_ptr error;
+            {
+                std::lock_guard lock(group.mutex);     // The last Finish has left the group
+                error = std::exchange(group.error, nullptr);
+            }
+            if (error) std::rethrow_exception(error);
+        }
+    };
+}
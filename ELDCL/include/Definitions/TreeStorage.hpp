@@ -0,0 +1,52 @@
+#pragma once
+#include "Types.hpp"
+#include <memory_resource>
+#include <mutex>
+
+
+namespace DCL
+{
+    // Arena of one ContainersTree: containers, their field vectors and indices are placed in a few
+    // large blocks and released together with the tree.
+    // Handles given out by NewContainer don't own anything: they're valid only while the storage lives.
+    class TreeStorage
+    {
+        std::pmr::monotonic_buffer_resource arena;
+        std::vector<Container*> containers;     // Destructors run on teardown, the memory goes back in one piece
+        std::vector<std::unique_ptr<TreeStorage>> children;    // Arenas of parallel decoding tasks
+        std::mutex children_mutex;
+
+    public:
+        explicit TreeStorage(size_t initial_block_size = 64 * 1024) : arena(initial_block_size) {}
+
+        //Forbid copying
+        TreeStorage(const TreeStorage&) = delete;
+        TreeStorage& operator=(const TreeStorage&) = delete;
+
+        ~TreeStorage()
+        {
+            for (auto it = containers.rbegin(); it != containers.rend(); ++it) {
+                (*it)->~Container();
+            }
+        }
+
+        std::pmr::memory_resource* GetResource() { return &arena; }
+
+        // The arena itself isn't thread-safe: every decoding task gets its own one, owned by this storage
+        TreeStorage* CreateChild()
+        {
+            std::lock_guard lock(children_mutex);
+            children.push_back(std::make_unique<TreeStorage>());
+            return children.back().get();
+        }
+
+        std::shared_ptr<Container> NewContainer()
+        {
+            void* memory = arena.allocate(sizeof(Container), alignof(Container));
+            Container* container = new (memory) Container(&arena);
+            containers.push_back(container);
+            // Aliasing constructor with an empty owner: no control block, no reference counting
+            return std::shared_ptr<Container>(std::shared_ptr<void>(), container);
+        }
+    };
+}
@@ -7,111 +7,239 @@
 #include <unordered_map>
 #include <functional>
 #include <unordered_set>
+#include <memory_resource>
+#include <atomic>
+#include <cstring>
+#include <string_view>
+#include <span>
+#include <mutex>
+#include <charconv>
+#include "SymbolTable.hpp"
 
 namespace DCL 
 {
-    enum ValueType { VOID, NUMBER, STRING, BOOL, ARRAY, CONTAINER }; 
+    enum ValueType : uint8_t { VOID, NUMBER, STRING, BOOL, ARRAY, CONTAINER }; 
 
     struct Value;
     struct Field;
-    
+    struct Container;
+    struct LazyValue;
 
-    struct Container 
+    // Parses the values of a tree decoded in lazy mode, owned by the tree
+    class LazyResolver
     {
-        std::string tag = "container";
-        std::string name = "container0";
-        std::vector<Field> ordered_fields;
-        std::shared_ptr<Container> parent;
-        std::vector<std::string> pending_copies;
+    public:
+        virtual ~LazyResolver() = default;
+        // Sets field.value and clears field.lazy, thread-safe
+        virtual void Resolve(Field& field, LazyValue& value) = 0;
+    };
 
-        Field* key;
+    // Value of a field decoded in lazy mode: only where it is written, parsed on the first FindField
+    struct LazyValue
+    {
+        LazyResolver* resolver;
+        Container* owner;           // The field is declared (and its references are resolved) here
+        uint32_t slot;              // Of the declared field in owner, copies of the field share the record
+        uint32_t size;
+        const char* text;           // Source bytes of the value, the tree keeps the source
+        uint32_t line;              // Of the text in the source, messages of the parse point there
+        bool resolving = false;     // Guards reference cycles, changed under the resolver's lock
+    };
+    
 
+    struct Container 
+    {
+        Symbol tag = SymbolTable::DEFAULT_TAG;
+        Symbol name = SymbolTable::DEFAULT_NAME;
+        std::pmr::vector<Field> ordered_fields;     // Declaration order. Add fields through AddField to keep field_index valid
+        std::pmr::unordered_map<Symbol, size_t> field_index;   // Name -> slot in ordered_fields, first declaration wins
+        Container* parent = nullptr;            // Parent owns the container, so it always outlives it
+        std::vector<Symbol> pending_copies;
+        SymbolTable* symbols = nullptr;         // Interner of the tree, owned by the tree
+
+        Field* key = nullptr;
+
+        Container() = default;
+        // Field storage taken from resource (the arena of the tree)
+        explicit Container(std::pmr::memory_resource* resource) : ordered_fields(resource), field_index(resource) {}
+
+        const std::string& GetName() const { return symbols->Name(name); }
+        const std::string& GetTag() const { return symbols->Name(tag); }
+
+        inline Field& AddField(Field field);
+        inline void RebuildIndex();
+        // Doesn't parse a lazy value, unlike FindField
+        bool HasField(Symbol name) const { return field_index.count(name) != 0; }
+        // Parses the lazy values of the container and of everything inside it
+        inline void EnsureValues();
+
+        inline Field* FindField(Symbol name);
         inline Field* FindField(const std::string& name);
+        // First field with the name which is (or isn't) a container
+        inline Field* FindField(Symbol name, bool is_container);
+        inline Field* FindField(const std::string& name, bool is_container);
+        inline std::shared_ptr<Container> FindChild(Symbol name);
+        inline std::shared_ptr<Container> FindChild(const std::string& name);
 
         inline std::unordered_map<std::string, Field*> FindFields(const std::vector<std::string>& field_names);
 
     };
 
+    // 16 bytes: numbers and bools inline, strings up to 14 chars inline (SSO),
+    // longer strings and arrays are immutable reference counted blocks shared between copies
     struct Value {          //Took from ELScript
-        ValueType type;
+    private:
+        static constexpr size_t INLINE_CAPACITY = 14;
 
-        union {
-            double numberVal;
-            bool boolVal;
+        struct StringRep
+        {
+            std::atomic<uint32_t> refs;
+            size_t size;
+            char* Data() { return reinterpret_cast<char*>(this + 1); }
+        };
+
+        struct ArrayRep
+        {
+            std::atomic<uint32_t> refs{ 1 };
+            std::vector<Value> items{};
+            std::vector<double> numbers{};      // Homogeneous numeric array, stored contiguously
+            bool numeric = false;
+            std::once_flag boxed_once{};        // items of a numeric array are built on first AsArray()
         };
-        std::string strVal;   // For strings
-        std::shared_ptr<std::vector<Value>> arrayVal; // For arrays
+
+        alignas(8) unsigned char payload[INLINE_CAPACITY] = {};    // double, bool, inline chars or a rep pointer
+        uint8_t inline_size = 0;                                // Length of an inline string
+    public:
+        ValueType type;
+
         // 
-        Value() : type(ValueType::VOID), numberVal(0) {}
+        Value() : type(ValueType::VOID) {}
 
-        Value(double v) : type(ValueType::NUMBER), numberVal(v) {}
-        Value(int v) : type(ValueType::NUMBER), numberVal(v) {}
+        Value(double v) : type(ValueType::NUMBER) { Store(v); }
+        Value(int v) : type(ValueType::NUMBER) { Store(static_cast<double>(v)); }
 
-        Value(bool v) : type(ValueType::BOOL), boolVal(v) {}
+        Value(bool v) : type(ValueType::BOOL) { Store(v); }
 
-        Value(const std::string& s) : type(ValueType::STRING) {
-            new (&strVal) std::string(s);
-        }
+        Value(std::string_view s) : type(ValueType::STRING) { InitString(s); }
+        Value(const std::string& s) : type(ValueType::STRING) { InitString(s); }
+        Value(const char* s) : type(ValueType::STRING) { InitString(s); }
 
-        Value(const char* s) : type(ValueType::STRING) {
-            new (&strVal) std::string(s);
+        Value(std::vector<Value> items) : type(ValueType::ARRAY) {
+            Store(new ArrayRep{ {1}, std::move(items) });
+        }
+        // Numeric array: elements live in one double buffer
+        Value(std::vector<double> numbers) : type(ValueType::ARRAY) {
+            Store(new ArrayRep{ {1}, {}, std::move(numbers), true });
         }
 
-        Value(std::shared_ptr<std::vector<Value>> arr) : type(ValueType::ARRAY), arrayVal(arr) {}
-        //   ( !)
-        //  
-        Value(const Value& other) : type(other.type) {
-            switch (type) {
-            case ValueType::NUMBER: numberVal = other.numberVal; break;
-            case ValueType::BOOL:   boolVal = other.boolVal; break;
-            case ValueType::STRING: new (&strVal) std::string(other.strVal); break; //  
-            case ValueType::ARRAY:  arrayVal = std::make_shared<std::vector<Value>>(*other.arrayVal); break; //   
-            case ValueType::VOID:   break; //   
-            }
+        // Copies share long strings and arrays
+        Value(const Value& other) : inline_size(other.inline_size), type(other.type) {
+            std::memcpy(payload, other.payload, INLINE_CAPACITY);
+            Retain();
         }
 
-        //  
         Value& operator=(const Value& other) {
             if (this == &other) return *this;
-            destroyCurrent();
-
+            other.Retain();
+            Release();
+            std::memcpy(payload, other.payload, INLINE_CAPACITY);
+            inline_size = other.inline_size;
             type = other.type;
-            switch (type) {
-            case ValueType::NUMBER: numberVal = other.numberVal; break;
-            case ValueType::BOOL:   boolVal = other.boolVal; break;
-            case ValueType::STRING: new (&strVal) std::string(other.strVal); break;
-            case ValueType::ARRAY:  arrayVal = std::make_shared<std::vector<Value>>(*other.arrayVal); break;
-            case ValueType::VOID:   break;
-            }
             return *this;
         }
-        Value(Value&& other) noexcept : type(other.type) {
-            switch (type) {
-            case ValueType::NUMBER: numberVal = other.numberVal; break;
-            case ValueType::BOOL:   boolVal = other.boolVal; break;
-            case ValueType::STRING: new (&strVal) std::string(std::move(other.strVal)); break;
-            case ValueType::ARRAY:  arrayVal = std::move(other.arrayVal); break; // :  shared_ptr
-            case ValueType::VOID:   break;
-            }
-            //         !
-            other.type = ValueType::VOID; //   other   
+
+        Value(Value&& other) noexcept : inline_size(other.inline_size), type(other.type) {
+            std::memcpy(payload, other.payload, INLINE_CAPACITY);
+            other.type = ValueType::VOID; //   other   
         }
 
-        //   
         Value& operator=(Value&& other) noexcept {
             if (this != &other) {
-                destroyCurrent(); //   
+                Release();
+                std::memcpy(payload, other.payload, INLINE_CAPACITY);
+                inline_size = other.inline_size;
                 type = other.type;
-                switch (type) {
-                case ValueType::NUMBER: numberVal = other.numberVal; break;
-                case ValueType::BOOL:   boolVal = other.boolVal; break;
-                case ValueType::STRING: new (&strVal) std::string(std::move(other.strVal)); break;
-                case ValueType::ARRAY:  arrayVal = std::move(other.arrayVal); break;
-                }
                 other.type = ValueType::VOID;
             }
             return *this;
         }
+
+        ~Value() {
+            Release();
+        }
+
+        double AsNumber() const { return type == ValueType::NUMBER ? Load<double>() : 0.0; }
+        bool AsBool() const { return type == ValueType::BOOL ? Load<bool>() : false; }
+
+        // Valid while this value (or a copy of it) lives
+        std::string_view AsString() const
+        {
+            if (type != ValueType::STRING) return {};
+            if (IsInlineString()) return std::string_view(reinterpret_cast<const char*>(payload), inline_size);
+            StringRep* rep = Load<StringRep*>();
+            return std::string_view(rep->Data(), rep->size);
+        }
+
+        bool IsNumericArray() const { return type == ValueType::ARRAY && Load<ArrayRep*>()->numeric; }
+
+        // Elements of a numeric array, empty for anything else
+        std::span<const double> AsNumbers() const
+        {
+            if (!IsNumericArray()) return {};
+            return Load<ArrayRep*>()->numbers;
+        }
+
+        size_t ArraySize() const
+        {
+            if (type != ValueType::ARRAY) return 0;
+            ArrayRep* rep = Load<ArrayRep*>();
+            return rep->numeric ? rep->numbers.size() : rep->items.size();
+        }
+
+        Value ArrayAt(size_t index) const
+        {
+            if (index >= ArraySize()) return Value();
+            ArrayRep* rep = Load<ArrayRep*>();
+            return rep->numeric ? Value(rep->numbers[index]) : rep->items[index];
+        }
+
+        // Numeric arrays are boxed into Values once, on the first call. Prefer AsNumbers/ArrayAt for them
+        const std::vector<Value>& AsArray() const
+        {
+            static const std::vector<Value> empty;
+            if (type != ValueType::ARRAY) return empty;
+            ArrayRep* rep = Load<ArrayRep*>();
+            if (rep->numeric) {
+                std::call_once(rep->boxed_once, [rep]() {
+                    rep->items.assign(rep->numbers.begin(), rep->numbers.end());
+                    });
+            }
+            return rep->items;
+        }
+
+        // Copy on write: the array is cloned if other values share it, numeric arrays become generic
+        std::vector<Value>& MutableArray()
+        {
+            if (type != ValueType::ARRAY) *this = Value(std::vector<Value>());
+            ArrayRep* rep = Load<ArrayRep*>();
+            if (rep->refs.load(std::memory_order_acquire) != 1 || rep->numeric) {
+                ArrayRep* copy = new ArrayRep{ {1}, AsArray() };
+                Release();
+                Store(copy);
+                type = ValueType::ARRAY;
+                rep = copy;
+            }
+            return rep->items;
+        }
+
+        // Shortest text that reads back to the same double, never in exponent form (the lexer can't read it)
+        static void FormatNumber(double number, std::string& out)
+        {
+            char buffer[400];
+            auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), number, std::chars_format::fixed);
+            out.append(buffer, error == std::errc() ? end : buffer);
+        }
+
         static std::string GetTypeString(ValueType type)
         {
             std::string result;
@@ -140,20 +268,20 @@ namespace DCL
             case VOID:
                 return "";
             case NUMBER:
-                if (EqualAround(numberVal, (int)numberVal), 0.0001f) return std::to_string((int)numberVal);
-                return std::to_string(numberVal);
+                FormatNumber(AsNumber(), result);
+                return result;
             case STRING:
-                return strVal;
+                return std::string(AsString());
             case BOOL:
-                return boolVal ? "true" : "false";
+                return AsBool() ? "true" : "false";
             case ARRAY:
-                for (auto l : *arrayVal)
+                for (const auto& l : AsArray())
                 {
                     
                     result += l.ToString() + ",";
                     
                 }
-                if (result.back() == ',')result.pop_back();
+                if (!result.empty() && result.back() == ',')result.pop_back();
                 return result;
 
             default:
@@ -161,26 +289,61 @@ namespace DCL
             }
         }
 
+    private:
+        template<typename T>
+        T Load() const
+        {
+            T result;
+            std::memcpy(&result, payload, sizeof(T));
+            return result;
+        }
 
-        // 
-        ~Value() {
-            destroyCurrent();
+        template<typename T>
+        void Store(T value)
+        {
+            std::memcpy(payload, &value, sizeof(T));
         }
-    private:
-        void destroyCurrent() {
-            //      
-            if (type == ValueType::STRING) {
-                strVal.~basic_string();
+
+        bool IsInlineString() const { return inline_size <= INLINE_CAPACITY; }
+
+        void InitString(std::string_view s)
+        {
+            if (s.size() <= INLINE_CAPACITY) {
+                std::memcpy(payload, s.data(), s.size());
+                inline_size = static_cast<uint8_t>(s.size());
+                return;
             }
-            //  shared_ptr      
+            void* memory = ::operator new(sizeof(StringRep) + s.size());
+            StringRep* rep = new (memory) StringRep{ {1}, s.size() };
+            std::memcpy(rep->Data(), s.data(), s.size());
+            Store(rep);
+            inline_size = INLINE_CAPACITY + 1;
         }
 
-        bool EqualAround(float n1, float n2, float interval = 0.01f) const  
+        void Retain() const
         {
-            return n2 <= n1 + interval && n2 >= n1 - interval;
+            if (type == ValueType::STRING && !IsInlineString()) Load<StringRep*>()->refs.fetch_add(1, std::memory_order_relaxed);
+            else if (type == ValueType::ARRAY) Load<ArrayRep*>()->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void Release()
+        {
+            if (type == ValueType::STRING && !IsInlineString()) {
+                StringRep* rep = Load<StringRep*>();
+                if (rep->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    rep->~StringRep();
+                    ::operator delete(rep);
+                }
+            }
+            else if (type == ValueType::ARRAY) {
+                ArrayRep* rep = Load<ArrayRep*>();
+                if (rep->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete rep;
+            }
+            type = ValueType::VOID;
         }
 
     };
+    static_assert(sizeof(Value) == 16, "Value must stay 16 bytes");
     
     struct Token;
 
@@ -188,20 +351,21 @@ namespace DCL
     {
         bool isKey;
         bool isContainer;
-        std::string name;
+        Symbol name;
         Value value;
         std::shared_ptr<Container> container;
         std::vector<Token> unresolved_tokens;
+        std::atomic<LazyValue*> lazy = nullptr;     // Not parsed yet (lazy mode), value is VOID until then
         // 
-        Field(std::string name, std::shared_ptr<Container> con, bool is_key = false)
-            : name(std::move(name)), container(std::move(con)), isContainer(true), isKey(is_key) {
+        Field(Symbol name, std::shared_ptr<Container> con, bool is_key = false)
+            : name(name), container(std::move(con)), isContainer(true), isKey(is_key) {
         }
 
-        Field(std::string name, Value val, bool is_key = false)
-            : name(std::move(name)), value(std::move(val)), isContainer(false), isKey(is_key) {
+        Field(Symbol name, Value val, bool is_key = false)
+            : name(name), value(std::move(val)), isContainer(false), isKey(is_key) {
         }
 
-        Field() : isContainer(false), isKey(false) {}
+        Field() : isContainer(false), isKey(false), name(SymbolTable::NO_SYMBOL) {}
 
         // 1.  (  , ..     )
         ~Field() = default;
@@ -213,7 +377,8 @@ namespace DCL
             name(other.name),
             value(other.value),  // Value    
             container(other.container),  // shared_ptr    
-            unresolved_tokens(other.unresolved_tokens)
+            unresolved_tokens(other.unresolved_tokens),
+            lazy(other.lazy.load(std::memory_order_acquire))
         {
         }
 
@@ -226,6 +391,7 @@ namespace DCL
                 value = other.value;
                 container = other.container;
                 unresolved_tokens = other.unresolved_tokens;
+                lazy.store(other.lazy.load(std::memory_order_acquire), std::memory_order_release);
             }
             return *this;
         }
@@ -234,10 +400,11 @@ namespace DCL
         Field(Field&& other) noexcept
             : isKey(other.isKey),
             isContainer(other.isContainer),
-            name(std::move(other.name)),
+            name(other.name),
             value(std::move(other.value)),
             container(std::move(other.container)),
-            unresolved_tokens(std::move(other.unresolved_tokens))
+            unresolved_tokens(std::move(other.unresolved_tokens)),
+            lazy(other.lazy.load(std::memory_order_acquire))
         {
             //  other   
             other.isKey = false;
@@ -249,34 +416,99 @@ namespace DCL
             if (this != &other) {
                 isKey = other.isKey;
                 // isContainer - ,   
-                name = std::move(other.name);
+                name = other.name;
                 value = std::move(other.value);
                 container = std::move(other.container);
                 unresolved_tokens = std::move(other.unresolved_tokens);
+                lazy.store(other.lazy.load(std::memory_order_acquire), std::memory_order_release);
                 other.isKey = false;
             }
             return *this;
         }
+
+        // Parses a lazy value, once: value can be read after that
+        void EnsureValue()
+        {
+            if (LazyValue* pending = lazy.load(std::memory_order_acquire)) pending->resolver->Resolve(*this, *pending);
+        }
     };
 
+    inline Field& Container::AddField(Field field)
+    {
+        field_index.try_emplace(field.name, ordered_fields.size());
+        ordered_fields.push_back(std::move(field));
+        return ordered_fields.back();
+    }
+
+    inline void Container::RebuildIndex()
+    {
+        field_index.clear();
+        field_index.reserve(ordered_fields.size());
+        for (size_t i = 0; i < ordered_fields.size(); i++) {
+            field_index.try_emplace(ordered_fields[i].name, i);
+        }
+    }
+
+    inline Field* Container::FindField(Symbol name)
+    {
+        auto it = field_index.find(name);
+        if (it == field_index.end()) return nullptr;
+        Field* field = &ordered_fields[it->second];
+        field->EnsureValue();
+        return field;
+    }
+
     inline Field* Container::FindField(const std::string& name)
     {
-        for (auto& field : ordered_fields) {
-            if (field.name == name) return &field;
+        return FindField(symbols->Find(name));
+    }
+
+    inline Field* Container::FindField(Symbol name, bool is_container)
+    {
+        Field* field = FindField(name);
+        if (field == nullptr || field->isContainer == is_container) return field;
+
+        // A field and a container share the name - rare, fall back to the scan
+        for (auto& f : ordered_fields) {
+            if (f.name == name && f.isContainer == is_container) {
+                f.EnsureValue();
+                return &f;
+            }
         }
         return nullptr;
     }
+
+    inline void Container::EnsureValues()
+    {
+        for (auto& field : ordered_fields) {
+            if (field.isContainer && field.container) field.container->EnsureValues();
+            else field.EnsureValue();
+        }
+    }
+
+    inline Field* Container::FindField(const std::string& name, bool is_container)
+    {
+        return FindField(symbols->Find(name), is_container);
+    }
+
+    inline std::shared_ptr<Container> Container::FindChild(Symbol name)
+    {
+        Field* field = FindField(name, true);
+        return field ? field->container : nullptr;
+    }
+
+    inline std::shared_ptr<Container> Container::FindChild(const std::string& name)
+    {
+        return FindChild(symbols->Find(name));
+    }
+
     inline std::unordered_map<std::string, Field*> Container::FindFields(const std::vector<std::string>& field_names)
     {
         std::unordered_map<std::string, Field*> result;
 
-        //  
         for (const auto& name : field_names) {
-            for (auto& field : ordered_fields) {
-                if (field.name == name) {
-                    result[name] = &field;
-                    break;
-                }
+            if (Field* field = FindField(name)) {
+                result[name] = field;
             }
             //    -     (   nullptr)
         }
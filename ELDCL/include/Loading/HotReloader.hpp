@@ -0,0 +1,383 @@
+#pragma once
+#include "Loader.hpp"
+#include <cstring>
+#include <unordered_set>
+
+
+namespace DCL
+{
+    // What one (re)load of a HotReloader did
+    struct ReloadResult
+    {
+        std::shared_ptr<ContainersTree> tree;               // The same tree patched in place, a new one after a full load
+        std::vector<std::shared_ptr<Container>> changed{};  // Top-level containers decoded again (edited ones and their
+                                                            // dependents), and the root when top-level values were
+        std::vector<std::shared_ptr<Container>> removed{};  // Top-level containers replaced or deleted. After a full
+                                                            // load in lazy mode they need the old tree to parse values
+        size_t decoded_bytes = 0;
+        bool full = false;                                  // Everything was decoded again
+    };
+
+    // Keeps a tree decoded from one text in step with edits of the text, for hot reload of large files.
+    // Every top-level statement has its byte range in the text. A reload compares the new text with the old one,
+    // lexes and decodes again only the statements in the changed range, and the statements which refer to what
+    // those declare (by name, through copy and references, transitively); their fields are spliced into the root
+    // and resolved against the rest of the tree.
+    // The tree is patched in place and NotifyChanged: nothing may read it during Reload. A tree given to
+    // SnapshotHandle::Publish is read while the next one is made, so it must not be patched: SetSnapshotMode makes
+    // every reload that changes something decode a new tree instead.
+    // Everything is decoded again when that would decode most of the text anyway, or when the text has copy or key
+    // statements at the top level (they change the root itself). Memory of replaced values isn't given back to
+    // the arena (arena mode) or to the lazy records (lazy mode) until the next full load
+    class HotReloader
+    {
+        struct Statement
+        {
+            size_t end;                 // Byte after the statement, it starts where the previous one ends
+            size_t fields;              // Top-level fields it made
+            bool root_level;            // copy or key straight in the root
+            std::vector<Symbol> uses;   // Names its values and copies look up
+            std::shared_ptr<SourceBuffer> source;   // Text it was decoded from, its lazy values point into it
+        };
+
+        LoadOptions options;
+        std::string filename;
+        std::unique_ptr<DecodeSession> session;
+        std::shared_ptr<ContainersTree> tree;
+        std::shared_ptr<Container> root;
+        std::shared_ptr<SourceBuffer> text;     // The text the statements are ranges of
+        std::vector<Statement> statements;
+        bool patchable = false;
+        bool snapshot_mode = false;
+
+        static std::shared_ptr<SourceBuffer> ReadFile(const std::string& filename)
+        {
+            // Copied out of the mapping: the file is rewritten while the tree still points into its text
+            auto mapped = SourceBuffer::FromFile(filename);
+            if (!mapped) {
+                std::cout << "Failed to open: " << filename << "\n";
+                return nullptr;
+            }
+            return SourceBuffer::FromString(std::string(mapped->Text()));
+        }
+
+        // Identifiers a statement looks up: the first names of references in values and the sources of copies.
+        // Field and container names it declares aren't lookups
+        void CollectUses(std::span<const Token> tokens, std::vector<Symbol>& uses)
+        {
+            bool value = false;
+            for (size_t i = 0; i < tokens.size(); i++) {
+                const Token& t = tokens[i];
+                if (t.type == TokenType::END || (t.type == TokenType::DELIMITER && (t.value == "{" || t.value == "}"))) value = false;
+                else if ((t.type == TokenType::OPERATOR && t.value == ":") || (t.type == TokenType::KEYWORD && t.value == "copy")) value = true;
+                else if (value && t.type == TokenType::IDENTIFIER && !(i > 0 && tokens[i - 1].value == "::"))
+                    uses.push_back(tree->GetSymbols().Intern(t.value));
+            }
+            std::sort(uses.begin(), uses.end());
+            uses.erase(std::unique(uses.begin(), uses.end()), uses.end());
+        }
+
+        // Statements of tokens lexed from text[begin, end): the last one runs to end, with what follows its terminator
+        void AppendStatements(std::span<const Token> tokens, const std::vector<DecodeSession::StatementBounds>& bounds,
+            size_t begin, size_t end, const std::shared_ptr<SourceBuffer>& source, std::vector<Statement>& out)
+        {
+            size_t token_begin = 0, field_begin = 0;
+            for (size_t k = 0; k < bounds.size(); k++) {
+                auto own = tokens.subspan(token_begin, bounds[k].token_end - token_begin);
+                Statement statement;
+                statement.end = k + 1 == bounds.size() ? end : begin + tokens[bounds[k].token_end - 1].offset + 1;
+                statement.fields = bounds[k].field_end - field_begin;
+                statement.root_level = own.front().type == TokenType::KEYWORD && (own.front().value == "copy" || own.front().value == "key");
+                statement.source = source;
+                CollectUses(own, statement.uses);
+                out.push_back(std::move(statement));
+                token_begin = bounds[k].token_end;
+                field_begin = bounds[k].field_end;
+            }
+            if (bounds.empty() && end > begin) out.push_back({ end, 0, false, {}, source });    // Spaces and comments only
+        }
+
+        // The tokens of a segment are whole top-level statements, so the text after it is lexed as before
+        static bool EndsStatement(const std::vector<Token>& tokens, size_t size)
+        {
+            size_t depth = 0;
+            for (const Token& t : tokens) {
+                if (t.type != TokenType::DELIMITER) continue;
+                if (t.value == "{") depth++;
+                else if (t.value == "}" && depth > 0) depth--;
+            }
+            if (tokens.empty() || depth != 0 || tokens.back().offset + 1 != size) return false;
+            return tokens.back().type == TokenType::END || tokens.back().value == "}";
+        }
+
+        // Texts are compared a block at a time with memcmp, then byte by byte inside the block which differs
+        static constexpr size_t COMPARE_BLOCK = 4096;
+
+        static size_t CommonPrefix(const char* a, const char* b, size_t size)
+        {
+            size_t i = 0;
+            while (i + COMPARE_BLOCK <= size && std::memcmp(a + i, b + i, COMPARE_BLOCK) == 0) i += COMPARE_BLOCK;
+            while (i < size && a[i] == b[i]) i++;
+            return i;
+        }
+
+        // a_end and b_end are the ends of the texts
+        static size_t CommonSuffix(const char* a_end, const char* b_end, size_t size)
+        {
+            size_t i = 0;
+            while (i + COMPARE_BLOCK <= size && std::memcmp(a_end - i - COMPARE_BLOCK, b_end - i - COMPARE_BLOCK, COMPARE_BLOCK) == 0)
+                i += COMPARE_BLOCK;
+            while (i < size && a_end[-1 - static_cast<ptrdiff_t>(i)] == b_end[-1 - static_cast<ptrdiff_t>(i)]) i++;
+            return i;
+        }
+
+        static void CollectTopLevel(const Container& container, std::vector<std::shared_ptr<Container>>& out)
+        {
+            for (auto& field : container.ordered_fields) {
+                if (field.isContainer && field.container) out.push_back(field.container);
+            }
+        }
+
+        // The tree keeps the texts the statements were decoded from, replaced ones are released
+        void KeepSources()
+        {
+            std::vector<std::shared_ptr<SourceBuffer>> kept;
+            std::unordered_set<const SourceBuffer*> seen;
+            for (auto& statement : statements) {
+                if (seen.insert(statement.source.get()).second) kept.push_back(statement.source);
+            }
+            tree->ReplaceSources(std::move(kept));
+        }
+
+        ReloadResult LoadAll(std::shared_ptr<SourceBuffer> source)
+        {
+            ReloadResult result;
+            result.full = true;
+            if (root) CollectTopLevel(*root, result.removed);
+
+            session = std::make_unique<DecodeSession>(std::make_shared<SymbolTable>(),
+                options.arena_mode ? std::make_shared<TreeStorage>() : nullptr, options.parallel_mode, options.lazy_mode);
+            auto tokens = Lexer::Get().ToTokens(*source);
+            std::vector<DecodeSession::StatementBounds> bounds;
+            auto part = session->BuildPart(tokens, &bounds);
+            root = session->NewRoot();
+            DecodeSession::AppendPart(*root, *part);
+            session->Resolve(root);
+            tree = session->MakeTree(root, source);
+            session->TakeKeyIndex();    // The tree has them now
+
+            statements.clear();
+            AppendStatements(tokens, bounds, 0, source->Size(), source, statements);
+            patchable = std::none_of(statements.begin(), statements.end(), [](const Statement& s) { return s.root_level; });
+            text = std::move(source);
+
+            result.tree = tree;
+            CollectTopLevel(*root, result.changed);
+            result.decoded_bytes = text->Size();
+            return result;
+        }
+
+        ReloadResult Patch(std::shared_ptr<SourceBuffer> source)
+        {
+            if (!tree || !patchable || snapshot_mode || statements.empty()) return LoadAll(std::move(source));
+
+            std::string_view before = text->Text(), after = source->Text();
+            size_t limit = std::min(before.size(), after.size());
+            size_t prefix = CommonPrefix(before.data(), after.data(), limit);
+            size_t suffix = CommonSuffix(before.data() + before.size(), after.data() + after.size(), limit - prefix);
+            ReloadResult result;
+            result.tree = tree;
+            if (prefix == limit && before.size() == after.size()) {
+                text = std::move(source);
+                return result;
+            }
+
+            // Statements over the changed bytes: from the one the change starts in to the one it ends in
+            auto begin_of = [this](size_t k) { return k == 0 ? size_t(0) : statements[k - 1].end; };
+            auto shifted = [&](size_t offset) { return offset - before.size() + after.size(); };   // Offsets after the change
+            size_t first = std::upper_bound(statements.begin(), statements.end(), prefix,
+                [](size_t offset, const Statement& s) { return offset < s.end; }) - statements.begin();
+            first = std::min(first, statements.size() - 1);
+            size_t last = std::lower_bound(statements.begin(), statements.end(), before.size() - suffix,
+                [](const Statement& s, size_t offset) { return s.end < offset; }) - statements.begin();
+            last = std::max(last, first);
+
+            // An edit may open a block or a string which something after it closes: take more statements, twice as many
+            // each time, until the range ends clean
+            size_t region_begin = begin_of(first), region_end;
+            std::shared_ptr<SourceBuffer> segment;
+            std::vector<Token> tokens;
+            while (true) {
+                region_end = shifted(statements[last].end);
+                if ((region_end - region_begin) * 2 > after.size()) return LoadAll(std::move(source));
+                segment = SourceBuffer::FromString(std::string(after.substr(region_begin, region_end - region_begin)));
+                tokens = Lexer::Get().ToTokens(*segment);
+                if (last + 1 == statements.size() || EndsStatement(tokens, segment->Size())) break;
+                last = std::min(statements.size() - 1, last + (last - first + 1));
+            }
+
+            std::vector<DecodeSession::StatementBounds> bounds;
+            auto edited_part = session->BuildPart(tokens, &bounds);
+            std::vector<Statement> edited;
+            AppendStatements(tokens, bounds, region_begin, region_end, segment, edited);
+            if (std::any_of(edited.begin(), edited.end(), [](const Statement& s) { return s.root_level; })) return LoadAll(std::move(source));
+
+            std::vector<size_t> first_slot(statements.size() + 1, 0);
+            for (size_t k = 0; k < statements.size(); k++) first_slot[k + 1] = first_slot[k] + statements[k].fields;
+
+            // Names declared by decoded statements, old and new, then everything that looks them up, transitively
+            std::vector<char> dirty(tree->GetSymbols().Size(), 0);
+            std::vector<char> decode(statements.size(), 0);
+            for (size_t slot = first_slot[first]; slot < first_slot[last + 1]; slot++) dirty[root->ordered_fields[slot].name] = 1;
+            for (auto& field : edited_part->ordered_fields) dirty[field.name] = 1;
+            for (size_t k = first; k <= last; k++) decode[k] = 1;
+            for (bool spread = true; spread; ) {
+                spread = false;
+                for (size_t k = 0; k < statements.size(); k++) {
+                    if (decode[k]) continue;
+                    bool uses_dirty = std::any_of(statements[k].uses.begin(), statements[k].uses.end(),
+                        [&](Symbol name) { return name < dirty.size() && dirty[name]; });
+                    if (!uses_dirty) continue;
+                    decode[k] = 1;
+                    spread = true;
+                    for (size_t slot = first_slot[k]; slot < first_slot[k + 1]; slot++) dirty[root->ordered_fields[slot].name] = 1;
+                }
+            }
+
+            result.decoded_bytes = region_end - region_begin;
+            for (size_t k = 0; k < statements.size(); k++) {
+                if (decode[k] && (k < first || k > last)) result.decoded_bytes += statements[k].end - begin_of(k);
+            }
+            if (result.decoded_bytes * 2 > after.size()) return LoadAll(std::move(source));
+
+            // Dependents are decoded again from their unchanged text, a run of adjacent ones at a time
+            struct Run
+            {
+                size_t first = 0, last = 0;
+                std::shared_ptr<Container> part{};
+                std::vector<Statement> statements{};
+            };
+            std::vector<Run> runs;
+            size_t edited_run = 0;
+            for (size_t k = 0; k < statements.size(); k++) {
+                if (k == first) {
+                    edited_run = runs.size();
+                    runs.push_back({ first, last, edited_part, std::move(edited) });
+                    k = last;
+                    continue;
+                }
+                if (!decode[k]) continue;
+                Run run{ k, k };
+                while (run.last + 1 < statements.size() && run.last + 1 != first && decode[run.last + 1]) run.last++;
+                size_t begin = begin_of(run.first), end = statements[run.last].end;
+                if (run.first > last) {
+                    begin = shifted(begin);
+                    end = shifted(end);
+                }
+                auto run_segment = SourceBuffer::FromString(std::string(after.substr(begin, end - begin)));
+                auto run_tokens = Lexer::Get().ToTokens(*run_segment);
+                bounds.clear();
+                run.part = session->BuildPart(run_tokens, &bounds);
+                AppendStatements(run_tokens, bounds, begin, end, run_segment, run.statements);
+                if (run.statements.size() != run.last - run.first + 1) return LoadAll(std::move(source));
+                k = run.last;
+                runs.push_back(std::move(run));
+            }
+
+            std::vector<DecodeSession::Splice> splices;
+            bool values_changed = false;
+            for (const Run& run : runs) {
+                DecodeSession::Splice splice{ first_slot[run.first], first_slot[run.last + 1] - first_slot[run.first], run.part };
+                for (size_t slot = splice.first; slot < splice.first + splice.count; slot++) {
+                    Field& field = root->ordered_fields[slot];
+                    if (field.isContainer && field.container) result.removed.push_back(field.container);
+                    else values_changed = true;
+                }
+                for (auto& field : run.part->ordered_fields) values_changed = values_changed || !field.isContainer;
+                splices.push_back(std::move(splice));
+            }
+
+            // Values of the replaced containers are parsed while their text is kept: it goes with the old statements
+            if (options.lazy_mode) {
+                for (auto& container : result.removed) container->EnsureValues();
+            }
+            std::vector<size_t> inserted;
+            DecodeSession::SpliceParts(*root, splices, inserted);
+            session->ResolveSlots(root, inserted);
+            tree->UpdateKeys(result.removed, session->TakeKeyIndex());
+
+            for (size_t slot : inserted) {
+                Field& field = root->ordered_fields[slot];
+                if (field.isContainer && field.container) result.changed.push_back(field.container);
+            }
+            if (values_changed) result.changed.push_back(root);
+
+            // The ranges of statements after the edited ones move with the text
+            text = std::move(source);
+            if (runs[edited_run].statements.size() == last - first + 1) {
+                // As many statements as before (dependents always have): they replace the old ones where they are
+                for (size_t k = last + 1; k < statements.size(); k++) statements[k].end = shifted(statements[k].end);
+                for (Run& run : runs) std::move(run.statements.begin(), run.statements.end(), statements.begin() + run.first);
+                KeepSources();
+                return result;
+            }
+            std::vector<Statement> updated;
+            updated.reserve(statements.size() + runs[edited_run].statements.size());
+            size_t next = 0;
+            for (Run& run : runs) {
+                for (; next < run.first; next++) {
+                    if (next > last) statements[next].end = shifted(statements[next].end);
+                    updated.push_back(std::move(statements[next]));
+                }
+                for (auto& statement : run.statements) updated.push_back(std::move(statement));
+                next = run.last + 1;
+            }
+            for (; next < statements.size(); next++) {
+                statements[next].end = shifted(statements[next].end);
+                updated.push_back(std::move(statements[next]));
+            }
+            statements = std::move(updated);
+            KeepSources();
+            return result;
+        }
+
+    public:
+        explicit HotReloader(const LoadOptions& options = {}) : options(options) {}
+
+        //Forbid copying
+        HotReloader(const HotReloader&) = delete;
+        HotReloader& operator=(const HotReloader&) = delete;
+
+        // Trees for SnapshotHandle::Publish: a changed text is decoded into a new tree, the old one is left as it is
+        void SetSnapshotMode(bool value) { snapshot_mode = value; }
+
+        // Decodes the whole file, ReloadFile reads it again. nullptr if the file can't be opened
+        std::shared_ptr<ContainersTree> LoadFile(const std::string& path)
+        {
+            filename = path;
+            auto source = ReadFile(filename);
+            return source ? LoadAll(std::move(source)).tree : nullptr;
+        }
+
+        std::shared_ptr<ContainersTree> Load(std::string content)
+        {
+            return LoadAll(SourceBuffer::FromString(std::move(content))).tree;
+        }
+
+        // The file given to LoadFile changed. When it can't be read the tree is left as it is
+        ReloadResult ReloadFile()
+        {
+            auto source = ReadFile(filename);
+            if (!source) return ReloadResult{ tree };
+            return Patch(std::move(source));
+        }
+
+        // New text of the whole input, for editors which have it in memory
+        ReloadResult Reload(std::string content)
+        {
+            return Patch(SourceBuffer::FromString(std::move(content)));
+        }
+
+        std::shared_ptr<ContainersTree> GetTree() const { return tree; }
+    };
+}
@@ -1,36 +1,277 @@
 #pragma once
 #include "..\Decoding\Decoder.hpp"
 #include "..\Tokenization\Lexer.hpp"
-#include <fstream>
+#include "..\Serialization\BinaryFormat.hpp"
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
 
 
 namespace DCL 
 {
+    struct LoadOptions
+    {
+        bool arena_mode = false;    // See Decoder::SetArenaMode
+        bool parallel_mode = false; // See Decoder::SetParallelMode
+        bool lazy_mode = false;     // See Decoder::SetLazyMode
+    };
+
+    struct FileLoadStats
+    {
+        std::string path;
+        size_t bytes = 0;
+        double lex_ms = 0;
+        double decode_ms = 0;       // Building of the file's structure, references are resolved for the whole catalog
+        bool loaded = false;
+    };
+
+    // Files loaded into one tree: top-level fields of all files share the root (in the order of the paths),
+    // copies and references resolve across files, key-fields of all files are in one key index
+    struct Catalog
+    {
+        std::shared_ptr<ContainersTree> tree;
+        std::vector<FileLoadStats> files;
+        double resolve_ms = 0;
+    };
+
     class Loader {
+        static std::shared_ptr<SourceBuffer> OpenFile(const std::string& filename) {
+            auto source = SourceBuffer::FromFile(filename);
+            if (!source) std::cout << "Failed to open: " << filename << "\n";
+            return source;
+        }
+
+        static bool ReadBinaryValue(BinaryFormat::Reader& in, Value& value, int depth = 0) {
+            if (depth > BinaryFormat::MAX_VALUE_DEPTH) return false;
+            switch (in.U8()) {
+            case ValueType::VOID:
+                value = Value();
+                break;
+            case ValueType::NUMBER:
+                value = Value(in.F64());
+                break;
+            case ValueType::BOOL:
+                value = Value(in.U8() != 0);
+                break;
+            case ValueType::STRING:
+                value = Value(in.String());
+                break;
+            case ValueType::ARRAY: {
+                bool numeric = in.U8() != 0;
+                uint32_t count = in.U32();
+                if (in.Failed()) return false;
+                if (numeric) {
+                    std::vector<double> numbers;
+                    numbers.reserve(std::min<size_t>(count, 1 << 20));
+                    for (uint32_t i = 0; i < count && !in.Failed(); i++) numbers.push_back(in.F64());
+                    value = Value(std::move(numbers));
+                }
+                else {
+                    std::vector<Value> items;
+                    items.reserve(std::min<size_t>(count, 1 << 20));
+                    for (uint32_t i = 0; i < count; i++) {
+                        if (!ReadBinaryValue(in, items.emplace_back(), depth + 1)) return false;
+                    }
+                    value = Value(std::move(items));
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+            return !in.Failed();
+        }
+
+        static std::shared_ptr<ContainersTree> InvalidBinary(const char* reason) {
+            std::cout << "Invalid binary DCL: " << reason << "\n";
+            return nullptr;
+        }
+
+        static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
     public:
-        static std::shared_ptr<ContainersTree> LoadFromFile(const std::string& filename) {
-            std::ifstream file(filename);
-            if (!file.is_open()) {
-                std::cout << "Failed to open: " << filename << "\n";
-                return nullptr;
+        static std::shared_ptr<ContainersTree> LoadFromFile(const std::string& filename, const LoadOptions& options = {}) {
+            auto source = OpenFile(filename);
+            if (!source) return nullptr;
+
+            return LoadFromSource(std::move(source), options);
+        }
+
+        // Output of Serializator::SerializeBinary: containers and fields are created straight from the tables,
+        // nothing is lexed or resolved. The tree doesn't keep data, values are copied out of it
+        static std::shared_ptr<ContainersTree> LoadBinary(const SourceBuffer& data, const LoadOptions& options = {}) {
+            BinaryFormat::Reader in(data.Text(), sizeof(BinaryFormat::MAGIC));
+            BinaryFormat::Header header;
+            header.version = in.U32();
+            header.symbols_count = in.U32();
+            header.containers_count = in.U32();
+            header.fields_count = in.U32();
+            header.keys_count = in.U32();
+            header.values_size = in.U64();
+            if (in.Failed()) return InvalidBinary("truncated header");
+            if (header.version == BinaryFormat::FROZEN_VERSION) return InvalidBinary("frozen image, open it with FrozenTree");
+            if (header.version != BinaryFormat::VERSION) return InvalidBinary("unsupported version");
+            if (header.containers_count == 0) return InvalidBinary("no root");
+
+            auto symbols = std::make_shared<SymbolTable>();
+            for (uint32_t i = 0; i < header.symbols_count; i++) {
+                // Ids are the positions in the table, the preinterned names come first
+                if (symbols->Intern(in.String()) != i || in.Failed()) return InvalidBinary("bad symbol table");
             }
 
-            std::string content((std::istreambuf_iterator<char>(file)),
-                std::istreambuf_iterator<char>());
+            size_t containers_offset = in.Position();
+            size_t fields_offset = containers_offset + size_t(header.containers_count) * BinaryFormat::CONTAINER_SIZE;
+            size_t keys_offset = fields_offset + size_t(header.fields_count) * BinaryFormat::FIELD_SIZE;
+            size_t values_offset = keys_offset + size_t(header.keys_count) * BinaryFormat::KEY_SIZE;
+            if (values_offset > data.Size() || data.Size() - values_offset < header.values_size) return InvalidBinary("truncated tables");
 
-            Lexer lexer;
-            auto tokens = lexer.ToTokens(content);
+            auto storage = options.arena_mode ? std::make_shared<TreeStorage>() : nullptr;
+            std::vector<std::shared_ptr<Container>> containers(header.containers_count);
+            for (auto& container : containers) {
+                container = storage ? storage->NewContainer() : std::make_shared<Container>();
+                container->symbols = symbols.get();
+            }
 
-            Decoder decoder;
-            return decoder.Decode(tokens);
+            BinaryFormat::Reader fields_in(data.Text());
+            BinaryFormat::Reader values_in(data.Text());
+            in.Seek(containers_offset);
+            for (uint32_t c = 0; c < header.containers_count; c++) {
+                Container& container = *containers[c];
+                container.tag = in.U32();
+                container.name = in.U32();
+                uint32_t first_field = in.U32();
+                uint32_t fields_count = in.U32();
+                uint32_t key_slot = in.U32();
+                if (container.tag >= header.symbols_count || container.name >= header.symbols_count ||
+                    first_field > header.fields_count || fields_count > header.fields_count - first_field)
+                    return InvalidBinary("bad container");
+
+                container.ordered_fields.reserve(fields_count);
+                fields_in.Seek(fields_offset + size_t(first_field) * BinaryFormat::FIELD_SIZE);
+                for (uint32_t f = 0; f < fields_count; f++) {
+                    Symbol name = fields_in.U32();
+                    uint8_t kind = fields_in.U8();
+                    bool is_key = fields_in.U8() != 0;
+                    fields_in.U16();
+                    uint32_t payload = fields_in.U32();
+                    if (name >= header.symbols_count) return InvalidBinary("bad field");
+
+                    if (kind == BinaryFormat::KIND_CONTAINER) {
+                        // Children come after their parents, so there are no cycles
+                        if (payload <= c || payload >= header.containers_count || containers[payload]->parent)
+                            return InvalidBinary("bad child");
+                        containers[payload]->parent = &container;
+                        container.AddField(Field(name, containers[payload], is_key));
+                    }
+                    else {
+                        Value value;
+                        if (payload >= header.values_size) return InvalidBinary("bad value offset");
+                        values_in.Seek(values_offset + payload);
+                        if (!ReadBinaryValue(values_in, value) || value.type != kind) return InvalidBinary("bad value");
+                        container.AddField(Field(name, std::move(value), is_key));
+                    }
+                }
+                if (key_slot != BinaryFormat::NO_INDEX) {
+                    if (key_slot >= container.ordered_fields.size()) return InvalidBinary("bad key slot");
+                    container.key = &container.ordered_fields[key_slot];
+                }
+            }
+            containers[0]->name = SymbolTable::ROOT;
+
+            std::unordered_map<std::string, std::shared_ptr<Container>> key_index;
+            in.Seek(keys_offset);
+            for (uint32_t k = 0; k < header.keys_count; k++) {
+                uint32_t offset = in.U32();
+                uint32_t container = in.U32();
+                if (offset >= header.values_size || container >= header.containers_count) return InvalidBinary("bad key");
+                values_in.Seek(values_offset + offset);
+                key_index[std::string(values_in.String())] = containers[container];
+            }
+            if (in.Failed() || fields_in.Failed() || values_in.Failed()) return InvalidBinary("truncated data");
+
+            auto root = containers[0];
+            containers.clear();
+            return std::make_shared<ContainersTree>(root, key_index, symbols, nullptr, storage);
+        }
+
+        // Files are read, lexed and built on ThreadPool::Get(), then joined and resolved once.
+        // Files which can't be opened are reported in the stats and skipped
+        static Catalog LoadMany(const std::vector<std::string>& paths, const LoadOptions& options = {}) {
+            Catalog catalog;
+            catalog.files.resize(paths.size());
+
+            DecodeSession session(std::make_shared<SymbolTable>(),
+                options.arena_mode ? std::make_shared<TreeStorage>() : nullptr, false, options.lazy_mode);
+            std::vector<std::shared_ptr<SourceBuffer>> sources(paths.size());
+            std::vector<std::shared_ptr<Container>> parts(paths.size());
+
+            ThreadPool& pool = ThreadPool::Get();
+            TaskGroup group;
+            for (size_t i = 0; i < paths.size(); i++) {
+                pool.Run(group, [&, i]() {
+                    FileLoadStats& stats = catalog.files[i];
+                    stats.path = paths[i];
+                    sources[i] = OpenFile(paths[i]);
+                    if (!sources[i]) return;
+                    stats.bytes = sources[i]->Size();
+
+                    auto start = std::chrono::steady_clock::now();
+                    auto tokens = Lexer::Get().ToTokens(*sources[i]);
+                    stats.lex_ms = MillisecondsSince(start);
+
+                    start = std::chrono::steady_clock::now();
+                    parts[i] = session.BuildPart(tokens);
+                    stats.decode_ms = MillisecondsSince(start);
+                    stats.loaded = true;
+                    });
+            }
+            pool.Wait(group);
+
+            auto start = std::chrono::steady_clock::now();
+            auto root = session.NewRoot();
+            for (auto& part : parts) {
+                if (part) DecodeSession::AppendPart(*root, *part);
+            }
+            parts.clear();
+            session.Resolve(root);
+            catalog.resolve_ms = MillisecondsSince(start);
+
+            catalog.tree = session.MakeTree(root, std::move(sources));
+            return catalog;
         }
 
-        static std::shared_ptr<ContainersTree> LoadFromString(const std::string& content) {
+        // All files with the extension under directory (subdirectories included), in path order
+        static Catalog LoadDirectory(const std::string& directory, const std::string& extension = ".dcl", const LoadOptions& options = {}) {
+            std::vector<std::string> paths;
+            std::error_code error;
+            for (std::filesystem::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+                if (it->is_regular_file(error) && it->path().extension() == extension) {
+                    paths.push_back(it->path().string());
+                }
+            }
+            if (error) std::cout << "Failed to read directory: " << directory << "\n";
+            std::sort(paths.begin(), paths.end());
+            return LoadMany(paths, options);
+        }
+
+        static std::shared_ptr<ContainersTree> LoadFromString(std::string content, const LoadOptions& options = {}) {
+            return LoadFromSource(SourceBuffer::FromString(std::move(content)), options);
+        }
+
+        // The tree retains source, tokens are spans over it
+        static std::shared_ptr<ContainersTree> LoadFromSource(std::shared_ptr<SourceBuffer> source, const LoadOptions& options = {}) {
+            if (BinaryFormat::HasMagic(source->Text())) return LoadBinary(*source, options);
+
             Lexer lexer;
-            auto tokens = lexer.ToTokens(content);
+            auto tokens = lexer.ToTokens(*source);
 
             Decoder decoder;
-            return decoder.Decode(tokens);
+            decoder.SetArenaMode(options.arena_mode);
+            decoder.SetParallelMode(options.parallel_mode);
+            decoder.SetLazyMode(options.lazy_mode);
+            return decoder.Decode(tokens, source);
         }
     };
 }
@@ -0,0 +1,147 @@
+#pragma once
+#include "Loader.hpp"
+#include <functional>
+#include <deque>
+
+
+namespace DCL
+{
+    // Push parser for input which arrives in pieces (sockets, pipes).
+    // Bytes are only scanned for the ends of top-level statements as they come: the scanner state (nesting depth,
+    // string literal, escape, comment) is kept between chunks, so a statement or a literal may be split anywhere.
+    // Every run of complete statements is lexed, built and resolved into the growing tree right away,
+    // and the top-level containers of it are handed out through the callback (or Poll without a callback).
+    // References and copies see what has arrived before them, not what comes later.
+    // One stream is not thread-safe: feed it from one thread.
+    class StreamLoader
+    {
+    public:
+        using ContainerCallback = std::function<void(const std::shared_ptr<Container>&)>;
+
+    private:
+        DecodeSession session;
+        std::shared_ptr<Container> root;
+        std::vector<std::shared_ptr<SourceBuffer>> sources;   // Segments the tokens of the tree point into
+        ContainerCallback on_container;
+        std::deque<std::shared_ptr<Container>> completed;     // Waiting for Poll when there is no callback
+
+        std::string pending;        // Bytes of statements which aren't complete yet
+        size_t scanned = 0;         // pending[0, scanned) is already seen by the scanner
+        size_t statement_end = 0;   // End of the last complete top-level statement in pending
+
+        // Scanner state, survives chunk boundaries
+        size_t depth = 0;
+        bool in_string = false;
+        bool escape = false;
+        bool in_comment = false;
+
+        // Position of pending[0] in the whole input, tokens of later segments continue the numbering
+        int line = 0;
+        int column = 0;
+
+        bool finished = false;
+
+        void Scan()
+        {
+            for (; scanned < pending.size(); scanned++) {
+                char c = pending[scanned];
+                if (in_comment) {
+                    if (c == '\n') in_comment = false;
+                    continue;
+                }
+                if (in_string) {
+                    if (escape) escape = false;
+                    else if (c == '\\') escape = true;
+                    else if (c == '"') in_string = false;
+                    continue;
+                }
+                if (c == '/') {
+                    if (scanned + 1 >= pending.size()) return;     // Can't tell a comment yet: wait for the next byte
+                    if (pending[scanned + 1] == '/') {
+                        in_comment = true;
+                        scanned++;
+                    }
+                    continue;
+                }
+                if (c == '"') in_string = true;
+                else if (c == '{') depth++;
+                else if (c == '}') {
+                    if (depth > 0) depth--;
+                    if (depth == 0) statement_end = scanned + 1;
+                }
+                else if (c == ';' && depth == 0) statement_end = scanned + 1;
+            }
+        }
+
+        // Lexes, builds and resolves pending[0, end) and drops it from pending
+        void DecodeSegment(size_t end)
+        {
+            auto source = SourceBuffer::FromString(pending.substr(0, end));
+            pending.erase(0, end);
+            scanned -= end;
+            statement_end = 0;
+
+            std::vector<Token> tokens;
+            Lexer::Cursor cursor = Lexer::Begin(*source);
+            cursor.line = line;
+            cursor.column = column;
+            Token token;
+            while (Lexer::Next(cursor, token)) tokens.push_back(token);
+            line = cursor.line;
+            column = cursor.column;
+
+            size_t first_slot = root->ordered_fields.size();
+            auto part = session.BuildPart(tokens);
+            DecodeSession::AppendPart(*root, *part);
+            session.ResolveFrom(root, first_slot);
+            sources.push_back(std::move(source));
+
+            for (size_t i = first_slot; i < root->ordered_fields.size(); i++) {
+                Field& field = root->ordered_fields[i];
+                if (!field.isContainer || !field.container) continue;
+                if (on_container) on_container(field.container);
+                else completed.push_back(field.container);
+            }
+        }
+
+    public:
+        explicit StreamLoader(ContainerCallback on_container = nullptr, const LoadOptions& options = {})
+            : session(std::make_shared<SymbolTable>(), options.arena_mode ? std::make_shared<TreeStorage>() : nullptr, false, options.lazy_mode),
+            on_container(std::move(on_container))
+        {
+            root = session.NewRoot();
+        }
+
+        //Forbid copying
+        StreamLoader(const StreamLoader&) = delete;
+        StreamLoader& operator=(const StreamLoader&) = delete;
+
+        // Takes the next piece of input. Containers completed by it are emitted before Feed returns
+        void Feed(std::string_view chunk)
+        {
+            if (finished) return;
+            pending.append(chunk);
+            Scan();
+            if (statement_end > 0) DecodeSegment(statement_end);
+        }
+
+        // Pull side: the next completed top-level container, false if none arrived yet
+        bool Poll(std::shared_ptr<Container>& container)
+        {
+            if (completed.empty()) return false;
+            container = std::move(completed.front());
+            completed.pop_front();
+            return true;
+        }
+
+        // End of input: decodes what is left (a last statement may have no ;) and gives the tree away.
+        // The stream accepts nothing after that
+        std::shared_ptr<ContainersTree> Finish()
+        {
+            if (finished) return nullptr;
+            finished = true;
+            if (!pending.empty()) DecodeSegment(pending.size());
+            return session.MakeTree(root, std::move(sources));
+        }
+    };
+}
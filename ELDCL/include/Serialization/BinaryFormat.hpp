@@ -0,0 +1,196 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+
+
+namespace DCL
+{
+    // Binary form of a resolved tree. All integers are little-endian, sections follow each other without padding:
+    //
+    //   Header
+    //   Symbols      symbols_count x { u32 length, bytes }               in Symbol order, so ids are kept
+    //   Containers   containers_count x { u32 tag, name, first_field, fields_count, key_slot }
+    //                                                                     0 is the root, children follow their parents
+    //   Fields       fields_count x { u32 name, u8 kind, u8 is_key, u16 reserved, u32 payload }
+    //                                                                     payload: child container or offset in Values
+    //   Keys         keys_count x { u32 offset of the key string in Values, u32 container }
+    //   Values       typed values: u8 ValueType, then
+    //                NUMBER f64 | BOOL u8 | STRING u32 length, bytes |
+    //                ARRAY u8 numeric, u32 count, count x f64 (numeric) or count x typed value
+    namespace BinaryFormat
+    {
+        inline constexpr char MAGIC[4] = { '\x7F', 'D', 'C', 'L' };  // Can't start a text file
+        inline constexpr uint32_t VERSION = 1;
+        inline constexpr uint32_t NO_INDEX = 0xFFFFFFFF;
+        inline constexpr uint8_t KIND_CONTAINER = 0xFF;             // Field kinds are ValueType otherwise
+        inline constexpr int MAX_VALUE_DEPTH = 64;                  // Deeper than any array the text format could have made
+
+        struct Header
+        {
+            uint32_t version = VERSION;
+            uint32_t symbols_count = 0;
+            uint32_t containers_count = 0;
+            uint32_t fields_count = 0;
+            uint32_t keys_count = 0;
+            uint64_t values_size = 0;
+        };
+
+        inline constexpr size_t CONTAINER_SIZE = 5 * 4;
+        inline constexpr size_t FIELD_SIZE = 4 + 1 + 1 + 2 + 4;
+        inline constexpr size_t KEY_SIZE = 4 + 4;
+
+        // === FROZEN IMAGE (version 2) ===
+        // Read in place by FrozenTree, so everything is fixed-size, aligned and addressed by offsets from the
+        // start of the image. Only little-endian hosts write and read it.
+        //
+        //   FrozenHeader
+        //   Symbols      symbols_count x FrozenString in Symbol order, text in Strings
+        //   SymbolOrder  symbols_count x u32 Symbol, sorted by name
+        //   Containers   containers_count x FrozenContainer, 0 is the root, children follow their parents
+        //   Fields       fields_count x FrozenField
+        //   FieldOrder   fields_count x u32: slots of the fields of each container sorted by (name, slot),
+        //                at the same positions as the fields
+        //   Keys         keys_count x FrozenKey, sorted by key
+        //   Strings      names and keys
+        //   Values       8-aligned FrozenValue records:
+        //                NUMBER f64 after the record | BOOL in size | STRING size bytes after the record |
+        //                ARRAY size x f64 (numeric) or size x u32 offsets of the items in Values
+        inline constexpr uint32_t FROZEN_VERSION = 2;
+        inline constexpr uint8_t VALUE_NUMERIC = 0x01;  // FrozenValue::flags of numeric arrays
+
+        struct FrozenHeader
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t symbols_count;
+            uint32_t containers_count;
+            uint32_t fields_count;
+            uint32_t keys_count;
+            uint64_t symbols_offset;
+            uint64_t symbol_order_offset;
+            uint64_t containers_offset;
+            uint64_t fields_offset;
+            uint64_t field_order_offset;
+            uint64_t keys_offset;
+            uint64_t strings_offset;
+            uint64_t strings_size;
+            uint64_t values_offset;
+            uint64_t values_size;
+            uint64_t size;              // Of the whole image
+        };
+
+        struct FrozenString { uint32_t offset; uint32_t size; };
+        struct FrozenContainer { uint32_t tag; uint32_t name; uint32_t first_field; uint32_t fields_count; uint32_t key_slot; };
+        struct FrozenField { uint32_t name; uint8_t kind; uint8_t is_key; uint16_t reserved; uint32_t payload; };
+        struct FrozenKey { FrozenString key; uint32_t container; };
+        struct FrozenValue { uint8_t type; uint8_t flags; uint16_t reserved; uint32_t size; };
+
+        static_assert(sizeof(FrozenHeader) == 112 && sizeof(FrozenString) == 8 && sizeof(FrozenContainer) == 20 &&
+            sizeof(FrozenField) == 12 && sizeof(FrozenKey) == 12 && sizeof(FrozenValue) == 8, "Frozen records must have no padding");
+
+        inline bool HasMagic(std::string_view data)
+        {
+            return data.size() >= sizeof(MAGIC) && std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) == 0;
+        }
+
+        class Writer
+        {
+            std::string& out;
+
+        public:
+            explicit Writer(std::string& out) : out(out) {}
+
+            size_t Size() const { return out.size(); }
+
+            void U8(uint8_t value) { out.push_back(static_cast<char>(value)); }
+            void U16(uint16_t value) { for (int i = 0; i < 2; i++) U8(static_cast<uint8_t>(value >> (i * 8))); }
+            void U32(uint32_t value) { for (int i = 0; i < 4; i++) U8(static_cast<uint8_t>(value >> (i * 8))); }
+            void U64(uint64_t value) { for (int i = 0; i < 8; i++) U8(static_cast<uint8_t>(value >> (i * 8))); }
+            void F64(double value)
+            {
+                uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                U64(bits);
+            }
+            void Bytes(std::string_view bytes) { out.append(bytes); }
+            // Frozen records are written as they are laid out in memory
+            template<typename T>
+            void Record(const T& record) { out.append(reinterpret_cast<const char*>(&record), sizeof(T)); }
+            void Align(size_t alignment) { out.resize((out.size() + alignment - 1) / alignment * alignment, '\0'); }
+            void String(std::string_view text)
+            {
+                U32(static_cast<uint32_t>(text.size()));
+                Bytes(text);
+            }
+        };
+
+        // Bounds-checked: reading past the end sets the error flag and yields zeros
+        class Reader
+        {
+            std::string_view data;
+            size_t position = 0;
+            bool failed = false;
+
+            bool Take(size_t count)
+            {
+                if (failed || count > data.size() - position) {
+                    failed = true;
+                    return false;
+                }
+                return true;
+            }
+
+        public:
+            explicit Reader(std::string_view data, size_t position = 0) : data(data), position(position) {}
+
+            bool Failed() const { return failed; }
+            size_t Position() const { return position; }
+            void Seek(size_t offset)
+            {
+                if (offset > data.size()) failed = true;
+                else position = offset;
+            }
+
+            uint8_t U8()
+            {
+                if (!Take(1)) return 0;
+                return static_cast<uint8_t>(data[position++]);
+            }
+            uint16_t U16()
+            {
+                uint16_t value = 0;
+                for (int i = 0; i < 2; i++) value |= static_cast<uint16_t>(U8()) << (i * 8);
+                return value;
+            }
+            uint32_t U32()
+            {
+                uint32_t value = 0;
+                for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(U8()) << (i * 8);
+                return value;
+            }
+            uint64_t U64()
+            {
+                uint64_t value = 0;
+                for (int i = 0; i < 8; i++) value |= static_cast<uint64_t>(U8()) << (i * 8);
+                return value;
+            }
+            double F64()
+            {
+                uint64_t bits = U64();
+                double value;
+                std::memcpy(&value, &bits, sizeof(value));
+                return value;
+            }
+            std::string_view Bytes(size_t count)
+            {
+                if (!Take(count)) return {};
+                std::string_view bytes = data.substr(position, count);
+                position += count;
+                return bytes;
+            }
+            std::string_view String() { return Bytes(U32()); }
+        };
+    }
+}
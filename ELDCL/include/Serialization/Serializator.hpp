@@ -1,5 +1,8 @@
 #pragma once
 #include "..\Decoding\ContainersTree.hpp"
+#include "BinaryFormat.hpp"
+#include <algorithm>
+#include <bit>
 
 
 
@@ -17,21 +20,274 @@ namespace DCL
         std::string Serialize(std::shared_ptr<ContainersTree> tree)
         {
             std::stringstream ss;
-            SerializeContainer(ss, tree->GetGlobalFields(), 0);
+            tree->EnsureValues();
+            SerializeContainer(ss, tree->GetGlobalFields(), tree->GetSymbols(), 0);
             return ss.str();
         }
         std::string Serialize(std::shared_ptr<Container> container)
         {
             if (!container) return "";
             std::stringstream ss;
-            ss << "tag::" << container->tag << " " << container->name << "\n{\n";
-            SerializeContainer(ss, container->ordered_fields, 0);
+            container->EnsureValues();
+            ss << "tag::" << container->GetTag() << " " << container->GetName() << "\n{\n";
+            SerializeContainer(ss, container->ordered_fields, *container->symbols, 0);
             ss << "}";
             return ss.str();
         }
+        // Binary form (see BinaryFormat.hpp), Loader reads it back without lexing
+        std::string SerializeBinary(std::shared_ptr<ContainersTree> tree)
+        {
+            tree->EnsureValues();
+            const SymbolTable& symbols = tree->GetSymbols();
+            std::string containers_section, fields_section, keys_section, values_section;
+            BinaryFormat::Writer containers_out(containers_section), fields_out(fields_section),
+                keys_out(keys_section), values_out(values_section);
+
+            // Breadth-first: children get their index when their parent is written
+            std::vector<const Container*> containers = { tree->GetRoot().get() };
+            std::unordered_map<const Container*, uint32_t> container_ids = { { containers[0], 0 } };
+            uint32_t fields_count = 0;
+            for (size_t c = 0; c < containers.size(); c++) {
+                const Container* container = containers[c];
+                containers_out.U32(container->tag);
+                containers_out.U32(container->name);
+                containers_out.U32(fields_count);
+                containers_out.U32(static_cast<uint32_t>(container->ordered_fields.size()));
+                containers_out.U32(container->key ? static_cast<uint32_t>(container->key - container->ordered_fields.data()) : BinaryFormat::NO_INDEX);
+
+                for (const auto& field : container->ordered_fields) {
+                    fields_out.U32(field.name);
+                    if (field.isContainer && field.container) {
+                        uint32_t child = static_cast<uint32_t>(containers.size());
+                        containers.push_back(field.container.get());
+                        container_ids[field.container.get()] = child;
+                        fields_out.U8(BinaryFormat::KIND_CONTAINER);
+                        fields_out.U8(field.isKey);
+                        fields_out.U16(0);
+                        fields_out.U32(child);
+                    }
+                    else {
+                        fields_out.U8(field.value.type);
+                        fields_out.U8(field.isKey);
+                        fields_out.U16(0);
+                        fields_out.U32(static_cast<uint32_t>(values_out.Size()));
+                        WriteValue(values_out, field.value);
+                    }
+                    fields_count++;
+                }
+            }
+
+            // Sorted, so readers may search the table
+            std::vector<std::pair<std::string, uint32_t>> keys;
+            for (const auto& [key, container] : tree->GetKeyIndex()) {
+                auto it = container_ids.find(container.get());
+                if (it != container_ids.end()) keys.emplace_back(key, it->second);
+            }
+            std::sort(keys.begin(), keys.end());
+            for (const auto& [key, container] : keys) {
+                keys_out.U32(static_cast<uint32_t>(values_out.Size()));
+                keys_out.U32(container);
+                values_out.String(key);
+            }
+
+            std::string result;
+            BinaryFormat::Writer out(result);
+            out.Bytes(std::string_view(BinaryFormat::MAGIC, sizeof(BinaryFormat::MAGIC)));
+            out.U32(BinaryFormat::VERSION);
+            out.U32(static_cast<uint32_t>(symbols.Size()));
+            out.U32(static_cast<uint32_t>(containers.size()));
+            out.U32(fields_count);
+            out.U32(static_cast<uint32_t>(keys.size()));
+            out.U64(values_section.size());
+            for (Symbol symbol = 0; symbol < symbols.Size(); symbol++) out.String(symbols.Name(symbol));
+            out.Bytes(containers_section);
+            out.Bytes(fields_section);
+            out.Bytes(keys_section);
+            out.Bytes(values_section);
+            return result;
+        }
+        // Frozen image (see BinaryFormat.hpp) for FrozenTree: queried in place, without loading
+        std::string SerializeFrozen(std::shared_ptr<ContainersTree> tree)
+        {
+            using namespace BinaryFormat;
+            static_assert(std::endian::native == std::endian::little, "Frozen images are little-endian");
+            tree->EnsureValues();
+            const SymbolTable& symbols = tree->GetSymbols();
+
+            std::string strings, values;
+            Writer strings_out(strings), values_out(values);
+            auto add_string = [&](std::string_view text) {
+                FrozenString result{ static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(text.size()) };
+                strings_out.Bytes(text);
+                return result;
+            };
+
+            std::vector<FrozenString> symbol_strings;
+            std::vector<uint32_t> symbol_order;
+            for (Symbol symbol = 0; symbol < symbols.Size(); symbol++) {
+                symbol_strings.push_back(add_string(symbols.Name(symbol)));
+                symbol_order.push_back(symbol);
+            }
+            std::sort(symbol_order.begin(), symbol_order.end(), [&](uint32_t a, uint32_t b) { return symbols.Name(a) < symbols.Name(b); });
+
+            std::vector<const Container*> containers = { tree->GetRoot().get() };
+            std::unordered_map<const Container*, uint32_t> container_ids = { { containers[0], 0 } };
+            std::vector<FrozenContainer> container_records;
+            std::vector<FrozenField> field_records;
+            std::vector<uint32_t> field_order;
+            for (size_t c = 0; c < containers.size(); c++) {
+                const Container* container = containers[c];
+                FrozenContainer record{ container->tag, container->name, static_cast<uint32_t>(field_records.size()),
+                    static_cast<uint32_t>(container->ordered_fields.size()),
+                    container->key ? static_cast<uint32_t>(container->key - container->ordered_fields.data()) : NO_INDEX };
+                container_records.push_back(record);
+
+                for (uint32_t slot = 0; slot < container->ordered_fields.size(); slot++) {
+                    const Field& field = container->ordered_fields[slot];
+                    FrozenField field_record{ field.name, 0, field.isKey, 0, 0 };
+                    if (field.isContainer && field.container) {
+                        field_record.kind = KIND_CONTAINER;
+                        field_record.payload = static_cast<uint32_t>(containers.size());
+                        container_ids[field.container.get()] = field_record.payload;
+                        containers.push_back(field.container.get());
+                    }
+                    else {
+                        field_record.kind = field.value.type;
+                        field_record.payload = WriteFrozenValue(values_out, field.value);
+                    }
+                    field_records.push_back(field_record);
+                    field_order.push_back(slot);
+                }
+                auto begin = field_order.begin() + record.first_field;
+                std::sort(begin, field_order.end(), [&](uint32_t a, uint32_t b) {
+                    const std::string& name_a = symbols.Name(container->ordered_fields[a].name);
+                    const std::string& name_b = symbols.Name(container->ordered_fields[b].name);
+                    return name_a != name_b ? name_a < name_b : a < b;
+                    });
+            }
+
+            std::vector<FrozenKey> keys;
+            for (const auto& [key, container] : tree->GetKeyIndex()) {
+                auto it = container_ids.find(container.get());
+                if (it != container_ids.end()) keys.push_back({ add_string(key), it->second });
+            }
+            std::sort(keys.begin(), keys.end(), [&](const FrozenKey& a, const FrozenKey& b) {
+                return std::string_view(strings).substr(a.key.offset, a.key.size) < std::string_view(strings).substr(b.key.offset, b.key.size);
+                });
+
+            std::string result;
+            Writer out(result);
+            FrozenHeader header{};
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = FROZEN_VERSION;
+            header.symbols_count = static_cast<uint32_t>(symbol_strings.size());
+            header.containers_count = static_cast<uint32_t>(container_records.size());
+            header.fields_count = static_cast<uint32_t>(field_records.size());
+            header.keys_count = static_cast<uint32_t>(keys.size());
+            out.Record(header);    // Rewritten at the end, when the offsets are known
+
+            auto write_section = [&](auto& records) {
+                out.Align(8);
+                uint64_t offset = out.Size();
+                for (const auto& record : records) out.Record(record);
+                return offset;
+            };
+            header.symbols_offset = write_section(symbol_strings);
+            header.symbol_order_offset = write_section(symbol_order);
+            header.containers_offset = write_section(container_records);
+            header.fields_offset = write_section(field_records);
+            header.field_order_offset = write_section(field_order);
+            header.keys_offset = write_section(keys);
+            out.Align(8);
+            header.strings_offset = out.Size();
+            header.strings_size = strings.size();
+            out.Bytes(strings);
+            out.Align(8);
+            header.values_offset = out.Size();
+            header.values_size = values.size();
+            out.Bytes(values);
+            header.size = out.Size();
+            std::memcpy(result.data(), &header, sizeof(header));
+            return result;
+        }
     private:
+        // Offset of the record in Values
+        uint32_t WriteFrozenValue(BinaryFormat::Writer& out, const Value& value)
+        {
+            using namespace BinaryFormat;
+            FrozenValue record{ value.type, 0, 0, 0 };
+            if (value.type == ValueType::ARRAY && !value.IsNumericArray()) {
+                // Items are placed first, the record is followed by the table of their offsets
+                std::vector<uint32_t> items;
+                for (const auto& item : value.AsArray()) items.push_back(WriteFrozenValue(out, item));
+                out.Align(8);
+                uint32_t offset = static_cast<uint32_t>(out.Size());
+                record.size = static_cast<uint32_t>(items.size());
+                out.Record(record);
+                for (uint32_t item : items) out.U32(item);
+                return offset;
+            }
+
+            out.Align(8);
+            uint32_t offset = static_cast<uint32_t>(out.Size());
+            switch (value.type) {
+            case ValueType::NUMBER:
+                out.Record(record);
+                out.F64(value.AsNumber());
+                break;
+            case ValueType::BOOL:
+                record.size = value.AsBool();
+                out.Record(record);
+                break;
+            case ValueType::STRING:
+                record.size = static_cast<uint32_t>(value.AsString().size());
+                out.Record(record);
+                out.Bytes(value.AsString());
+                break;
+            case ValueType::ARRAY:
+                record.size = static_cast<uint32_t>(value.ArraySize());
+                record.flags = VALUE_NUMERIC;
+                out.Record(record);
+                for (double number : value.AsNumbers()) out.F64(number);
+                break;
+            default:
+                out.Record(record);
+                break;
+            }
+            return offset;
+        }
+
+        void WriteValue(BinaryFormat::Writer& out, const Value& value)
+        {
+            out.U8(value.type);
+            switch (value.type) {
+            case ValueType::NUMBER:
+                out.F64(value.AsNumber());
+                break;
+            case ValueType::BOOL:
+                out.U8(value.AsBool());
+                break;
+            case ValueType::STRING:
+                out.String(value.AsString());
+                break;
+            case ValueType::ARRAY:
+                out.U8(value.IsNumericArray());
+                out.U32(static_cast<uint32_t>(value.ArraySize()));
+                if (value.IsNumericArray()) {
+                    for (double number : value.AsNumbers()) out.F64(number);
+                }
+                else {
+                    for (const auto& item : value.AsArray()) WriteValue(out, item);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
         void SerializeContainer(std::stringstream& ss,
-            const std::vector<Field>& fields,
+            const std::pmr::vector<Field>& fields,
+            const SymbolTable& symbols,
             int indent_level)
         {
             std::string indent(indent_level * 4, ' '); // 4   
@@ -39,22 +295,22 @@ namespace DCL
             for (const auto& field : fields) {
                 if (field.isKey && !field.isContainer) {
                     // key Name = value
-                    ss << indent << "key " << field.name << " = " << FieldValueToString(field.value) << ";\n";
+                    ss << indent << "key " << symbols.Name(field.name) << " = " << FieldValueToString(field.value) << ";\n";
                 }
                 else if (field.isContainer) {
                     // : tag::type Name { ... }
-                    ss << indent << "tag::" << field.container->tag
-                        << " " << field.name << "\n";
+                    ss << indent << "tag::" << field.container->GetTag()
+                        << " " << symbols.Name(field.name) << "\n";
                     ss << indent << "{\n";
 
                     //    
-                    SerializeContainer(ss, field.container->ordered_fields, indent_level + 1);
+                    SerializeContainer(ss, field.container->ordered_fields, symbols, indent_level + 1);
 
                     ss << indent << "}\n\n";
                 }
                 else {
                     //  : Name: Value;
-                    ss << indent << field.name << ": " << FieldValueToString(field.value) << ";\n";
+                    ss << indent << symbols.Name(field.name) << ": " << FieldValueToString(field.value) << ";\n";
                 }
             }
         }
@@ -64,13 +320,20 @@ namespace DCL
             std::string result;
             switch (value.type) {
             case ValueType::STRING:
-                return EscapeString(value.strVal);
+                return EscapeString(value.AsString());
+
+            case ValueType::NUMBER:
+                Value::FormatNumber(value.AsNumber(), result);
+                return result;
 
             case ValueType::ARRAY: {
+                if (value.IsNumericArray()) return NumbersToString(value.AsNumbers());
+
                 std::string result = "[";
-                for (size_t i = 0; i < value.arrayVal->size(); i++) {
+                const auto& items = value.AsArray();
+                for (size_t i = 0; i < items.size(); i++) {
                     if (i > 0) result += ", ";
-                    result += FieldValueToString((*value.arrayVal)[i]);
+                    result += FieldValueToString(items[i]);
                 }
                 result += "]";
                 return result;
@@ -80,7 +343,20 @@ namespace DCL
             }
         }
 
-        std::string EscapeString(const std::string& str)
+        // Numeric arrays are written straight from their double buffer
+        std::string NumbersToString(std::span<const double> numbers)
+        {
+            std::string result = "[";
+            result.reserve(numbers.size() * 8 + 2);
+            for (size_t i = 0; i < numbers.size(); i++) {
+                if (i > 0) result += ", ";
+                Value::FormatNumber(numbers[i], result);
+            }
+            result += "]";
+            return result;
+        }
+
+        std::string EscapeString(std::string_view str)
         {
             std::string result;
             result.reserve(str.length() + 10); //   
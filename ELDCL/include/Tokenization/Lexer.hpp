@@ -1,32 +1,34 @@
 #pragma once
 #include "TokensInfo.hpp"
+#include "SourceBuffer.hpp"
+#include "Scanner.hpp"
 #include <iostream>
+#include <algorithm>
 
 
 namespace DCL 
 {
 	class Lexer 
 	{
+	public:
+		// Position of one pass over a source. All the mutable state of lexing lives here,
+		// so a single Lexer can be used by any number of threads at once.
+		struct Cursor
+		{
+			SourceBuffer* source = nullptr;
+			size_t position = 0;
+			int line = 0;
+			int column = 0;	// Column of the last consumed char
+			std::deque<std::string>* literals = nullptr;	// Where escaped literals are materialized, the source if nullptr
+		};
+
 	private:
 		bool m_debug_mode = false;
 
-		std::string undefined_token = std::string();
-		int current_line = 0;
-		int current_column = 0;
-		bool was_comment = false;
-		bool is_negative_value = false; // -10
-
-		void ResetState() 
-		{
-			undefined_token = std::string();
-			current_line = 0;
-			current_column = 0;
-			was_comment = false;
-			is_negative_value = false; 
-		}
+		// Chars which end an identifier/number
+		static constexpr uint8_t BREAK_CLASSES = CC_SPACE | CC_NEWLINE | CC_RETURN | CC_DELIMITER | CC_END | CC_OPERATOR;
 
-
-		char32_t ProcessESC(const std::string& code, size_t& i) {
+		static char32_t ProcessESC(std::string_view code, size_t& i) {
 			
 			if (i + 1 >= code.size()) return 0;
 
@@ -38,21 +40,65 @@ namespace DCL
 			if (next == '\\') return '\\';
 			return next;
 		}
-		Token HandleStringLiteral(const std::string& code, size_t& i)
+		// Literal without escapes and \r stays a span over the source, otherwise it's materialized
+		static Token HandleStringLiteral(Cursor& cursor)
 		{
-			std::string result;
+			SourceBuffer& source = *cursor.source;
+			std::string_view code = source.Text();
+			size_t& i = cursor.position;
+			size_t start = i;
+			bool needs_copy = false;
 			for (; i < code.size(); i++)
 			{
+				// Jump over the plain part of the literal
+				size_t special = Scanner::FindStringSpecial(code, i);
+				cursor.column += static_cast<int>(special - i);
+				i = special;
+				if (i >= code.size()) break;
+
+				char c = code[i];
+				if (c == '"') break;
+				if (c == '\r' || c == '\\') {
+					needs_copy = true;
+					break;
+				}
+				if (c == '\n') {
+					cursor.line++;
+					cursor.column = 0;
+				}
+			}
+
+			Token t;
+			t.offset = start;
+			t.type = TokenType::STRING_LITERAL;
+			if (!needs_copy) {
+				if (i < code.size()) cursor.column++;	// Closing "
+				t.value = code.substr(start, i - start);
+				t.column = cursor.column;
+				t.line = cursor.line;
+				if (i < code.size()) i++;
+				return t;
+			}
+
+			std::string result(code.substr(start, i - start));
+			for (; i < code.size(); i++)
+			{
+				size_t special = Scanner::FindStringSpecial(code, i);
+				result.append(code.substr(i, special - i));
+				cursor.column += static_cast<int>(special - i);
+				i = special;
+				if (i >= code.size()) break;
+
 				char c = code[i];  
 				if (c == '"') {   
-					current_column++; 
+					cursor.column++; 
 					break;
 				}
 				if (c == '\r') continue;
 				//   
 				if (c == '\n') {
-					current_line++;
-					current_column = 0;
+					cursor.line++;
+					cursor.column = 0;
 					result.push_back(c);
 					continue;
 				}
@@ -63,35 +109,37 @@ namespace DCL
 					if (esc != 0) {
 						result.push_back(esc);
 						i++; //    (  )
-						current_column += 2; //   : \  x
+						cursor.column += 2; //   : \  x
 						continue;
 					}
 				}
 				result.push_back(c);
-				current_column++;
+				cursor.column++;
 			}
-			Token t;
-			t.value = result;
-			t.column = current_column;
-			t.line = current_line;
-			t.type = TokenType::STRING_LITERAL;
+			if (cursor.literals) {
+				cursor.literals->push_back(std::move(result));
+				t.value = cursor.literals->back();
+			}
+			else {
+				t.value = source.Materialize(std::move(result));
+			}
+			t.column = cursor.column;
+			t.line = cursor.line;
+			if (i < code.size()) i++;
 			return t;
 		}
-		bool IsDelimiter(char c) {
-			TokenType type = TokenMap::DetermineTokenType(std::string(1, c));
-			return (type & (TokenType::DELIMITER | TokenType::END)) != 0;
-		}
 
-		Token CreateToken(const std::string& value) {
+		static Token CreateToken(std::string_view code, size_t offset, size_t length, int line, int column) {
 			Token t;
-			t.value = value;
-			t.column = current_column;
-			t.line = current_line;
-			t.type = TokenMap::DetermineTokenType(value); //  
+			t.value = code.substr(offset, length);
+			t.offset = offset;
+			t.column = column;
+			t.line = line;
+			t.type = TokenMap::DetermineTokenType(t.value);
 			return t;
 		}
 
-		void PrintTokens(const std::vector<Token>& tokens) 
+		void PrintTokens(const std::vector<Token>& tokens) const
 		{
 			for (auto t : tokens) 
 			{
@@ -114,75 +162,96 @@ namespace DCL
 		}
 		void SetDebugMode(bool value) { m_debug_mode = value; }
 
+		static Cursor Begin(SourceBuffer& source)
+		{
+			Cursor cursor;
+			cursor.source = &source;
+			return cursor;
+		}
 
-		std::vector<Token> ToTokens(const std::string& code)
+		// Pull interface: reads the next token, false at the end of the source.
+		// Tokens are spans over source, so source must outlive them
+		static bool Next(Cursor& cursor, Token& token)
 		{
-			ResetState();
-			std::vector<Token> tokens;
+			std::string_view code = cursor.source->Text();
+			size_t& i = cursor.position;
 
-			for (size_t i = 0; i < code.size(); i++)
+			while (i < code.size())
 			{
 				char c = code[i];  // char  char32_t  
-				if (c == '\r') continue;
+				uint8_t char_class = TokenMap::GetCharClass(c);
+				if (c == '\r') {
+					i++;
+					continue;
+				}
+
+				//    
+				if (char_class & (CC_SPACE | CC_NEWLINE)) {
+					cursor.column++;
+					if (c == '\n') {
+						cursor.line++;
+						cursor.column = 0;
+					}
+					// Indentation and alignment come in runs
+					size_t end = Scanner::SkipSpaces(code, i + 1);
+					cursor.column += static_cast<int>(end - i - 1);
+					i = end;
+					continue;
+				}
 
-				current_column++;
+				cursor.column++;
 
 				//   
-				if (c == '\"' && undefined_token.empty()) {
-					tokens.push_back(HandleStringLiteral(code, ++i)); // ++i    "
-					continue;
+				if (c == '\"') {
+					i++;	//   "
+					token = HandleStringLiteral(cursor);
+					return true;
 				}
 
 				// 
 				if (c == '/' && i + 1 < code.size() && code[i + 1] == '/') {
 					//    
-					while (i < code.size() && code[i] != '\n') i++;
-					current_line++;
-					current_column = 0;
+					i = std::min(Scanner::FindLineEnd(code, i) + 1, code.size());
+					cursor.line++;
+					cursor.column = 0;
 					continue;
 				}
 
 				//  
-				if (IsDelimiter(c)) {
-					if (!undefined_token.empty()) {
-						tokens.push_back(CreateToken(undefined_token));
-						undefined_token.clear();
-					}
-					tokens.push_back(CreateToken(std::string(1, c)));
-					continue;
+				if (char_class & (CC_DELIMITER | CC_END)) {
+					token = CreateToken(code, i, 1, cursor.line, cursor.column);
+					i++;
+					return true;
 				}
 
-				//    
-				if (std::isspace(c)) {
-					if (!undefined_token.empty()) {
-						tokens.push_back(CreateToken(undefined_token));
-						undefined_token.clear();
-					}
-					if (c == '\n') {
-						current_line++;
-						current_column = 0;
-					}
-					continue;
+				if (size_t oper = TokenMap::GetOperatorLength(code, i); oper != 0) 
+				{
+					token = CreateToken(code, i, oper, cursor.line, cursor.column);
+					i += oper;
+					return true;
 				}
 
-				if (std::string oper = TokenMap::GetOperator(code, i); oper != "") 
-				{
-					if (!undefined_token.empty()) {
-						tokens.push_back(CreateToken(undefined_token));
-						undefined_token.clear();
-					}
-					tokens.push_back(CreateToken(oper));
+				// Identifier or number: up to the next char which ends it
+				size_t start = i++;
+				while (i < code.size() && !(TokenMap::GetCharClass(code[i]) & BREAK_CLASSES)) {
+					cursor.column++;
 					i++;
-					continue;
 				}
-				undefined_token.push_back(c);
-			}
-
-			//    
-			if (!undefined_token.empty()) {
-				tokens.push_back(CreateToken(undefined_token));
+				// Position is reported at the char which ended the token (\r isn't counted as a column)
+				int column = cursor.column + (i < code.size() && code[i] != '\r' ? 1 : 0);
+				token = CreateToken(code, start, i - start, cursor.line, column);
+				return true;
 			}
+			return false;
+		}
 
+		// Tokens are spans over source, so source must outlive them
+		std::vector<Token> ToTokens(SourceBuffer& source) const
+		{
+			std::vector<Token> tokens;
+			Cursor cursor = Begin(source);
+			Token token;
+			while (Next(cursor, token)) tokens.push_back(token);
 
 			if (m_debug_mode) 
 			{
@@ -192,4 +261,4 @@ namespace DCL
 			return tokens;
 		}
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,221 @@
+#pragma once
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define DCL_SCANNER_X64 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DCL_TARGET_AVX2
+#else
+#define DCL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+
+namespace DCL
+{
+	// Fast skipping of long runs the lexer isn't interested in: whitespace, comment bodies, string literals.
+	// SSE2 is the baseline on x64, AVX2 is picked at runtime, other platforms use the scalar loops.
+	class Scanner
+	{
+	public:
+		enum class Level { SCALAR, SSE2, AVX2 };
+
+	private:
+		using FindFunction = size_t(*)(std::string_view, size_t);
+
+		struct Dispatch
+		{
+			Level level = Level::SCALAR;
+			FindFunction skip_spaces = SkipSpacesScalar;
+			FindFunction find_string_special = FindStringSpecialScalar;
+		};
+
+		// === SCALAR ===
+
+		static size_t SkipSpacesScalar(std::string_view code, size_t i)
+		{
+			while (i < code.size() && (code[i] == ' ' || code[i] == '\t')) i++;
+			return i;
+		}
+
+		static bool IsStringSpecial(char c)
+		{
+			return c == '"' || c == '\\' || c == '\n' || c == '\r';
+		}
+
+		static size_t FindStringSpecialScalar(std::string_view code, size_t i)
+		{
+			while (i < code.size() && !IsStringSpecial(code[i])) i++;
+			return i;
+		}
+
+#ifdef DCL_SCANNER_X64
+		static int CountTrailingZeros(uint32_t mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return static_cast<int>(index);
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		// === SSE2 ===
+
+		static size_t SkipSpacesSSE2(std::string_view code, size_t i)
+		{
+			const __m128i space = _mm_set1_epi8(' ');
+			const __m128i tab = _mm_set1_epi8('\t');
+			for (; i + 16 <= code.size(); i += 16) {
+				__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(code.data() + i));
+				__m128i blank = _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab));
+				uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_epi8(blank)) & 0xFFFF;
+				if (mask != 0) return i + CountTrailingZeros(mask);
+			}
+			return SkipSpacesScalar(code, i);
+		}
+
+		static size_t FindStringSpecialSSE2(std::string_view code, size_t i)
+		{
+			const __m128i quote = _mm_set1_epi8('"');
+			const __m128i slash = _mm_set1_epi8('\\');
+			const __m128i newline = _mm_set1_epi8('\n');
+			const __m128i ret = _mm_set1_epi8('\r');
+			for (; i + 16 <= code.size(); i += 16) {
+				__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(code.data() + i));
+				__m128i special = _mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, slash)),
+					_mm_or_si128(_mm_cmpeq_epi8(chunk, newline), _mm_cmpeq_epi8(chunk, ret)));
+				uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(special));
+				if (mask != 0) return i + CountTrailingZeros(mask);
+			}
+			return FindStringSpecialScalar(code, i);
+		}
+
+		// === AVX2 ===
+
+		DCL_TARGET_AVX2 static size_t SkipSpacesAVX2(std::string_view code, size_t i)
+		{
+			const __m256i space = _mm256_set1_epi8(' ');
+			const __m256i tab = _mm256_set1_epi8('\t');
+			for (; i + 32 <= code.size(); i += 32) {
+				__m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(code.data() + i));
+				__m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab));
+				uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(blank));
+				if (mask != 0) return i + CountTrailingZeros(mask);
+			}
+			return SkipSpacesSSE2(code, i);
+		}
+
+		DCL_TARGET_AVX2 static size_t FindStringSpecialAVX2(std::string_view code, size_t i)
+		{
+			const __m256i quote = _mm256_set1_epi8('"');
+			const __m256i slash = _mm256_set1_epi8('\\');
+			const __m256i newline = _mm256_set1_epi8('\n');
+			const __m256i ret = _mm256_set1_epi8('\r');
+			for (; i + 32 <= code.size(); i += 32) {
+				__m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(code.data() + i));
+				__m256i special = _mm256_or_si256(
+					_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, slash)),
+					_mm256_or_si256(_mm256_cmpeq_epi8(chunk, newline), _mm256_cmpeq_epi8(chunk, ret)));
+				uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(special));
+				if (mask != 0) return i + CountTrailingZeros(mask);
+			}
+			return FindStringSpecialSSE2(code, i);
+		}
+
+		static bool CpuHasAVX2()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) return false;
+			__cpuid(info, 1);
+			bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+			__cpuidex(info, 7, 0);
+			return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+		}
+#endif
+
+		static Dispatch Detect()
+		{
+			Dispatch dispatch;
+#ifdef DCL_SCANNER_X64
+			if (CpuHasAVX2()) {
+				dispatch.level = Level::AVX2;
+				dispatch.skip_spaces = SkipSpacesAVX2;
+				dispatch.find_string_special = FindStringSpecialAVX2;
+			}
+			else {
+				dispatch.level = Level::SSE2;
+				dispatch.skip_spaces = SkipSpacesSSE2;
+				dispatch.find_string_special = FindStringSpecialSSE2;
+			}
+#endif
+			return dispatch;
+		}
+
+		static Dispatch& GetDispatch()
+		{
+			static Dispatch dispatch = Detect();
+			return dispatch;
+		}
+
+	public:
+		static Level GetLevel() { return GetDispatch().level; }
+
+		// Forces a lower level (benchmarks, checking the paths against each other). Not thread safe: call it
+		// before lexing starts. False if the CPU doesn't support the level
+		static bool SetLevel(Level level)
+		{
+			Dispatch& dispatch = GetDispatch();
+			switch (level)
+			{
+			case Level::SCALAR:
+				dispatch = Dispatch();
+				return true;
+#ifdef DCL_SCANNER_X64
+			case Level::SSE2:
+				dispatch = { Level::SSE2, SkipSpacesSSE2, FindStringSpecialSSE2 };
+				return true;
+			case Level::AVX2:
+				if (!CpuHasAVX2()) return false;
+				dispatch = { Level::AVX2, SkipSpacesAVX2, FindStringSpecialAVX2 };
+				return true;
+#endif
+			default:
+				return false;
+			}
+		}
+
+		// First index >= i which isn't ' ' or '\t'
+		static size_t SkipSpaces(std::string_view code, size_t i)
+		{
+			return GetDispatch().skip_spaces(code, i);
+		}
+
+		// First '\n' at or after i (end of a comment), code.size() if there is none
+		static size_t FindLineEnd(std::string_view code, size_t i)
+		{
+			if (i >= code.size()) return code.size();
+			// memchr is vectorized by every C runtime we build with
+			const void* found = std::memchr(code.data() + i, '\n', code.size() - i);
+			return found ? static_cast<const char*>(found) - code.data() : code.size();
+		}
+
+		// First '"', '\\', '\n' or '\r' at or after i, code.size() if there is none
+		static size_t FindStringSpecial(std::string_view code, size_t i)
+		{
+			return GetDispatch().find_string_special(code, i);
+		}
+	};
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <cerrno>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+namespace DCL
+{
+	// Owns the text that tokens point into (a string or a mapped file). Tokens are spans over Text(), string literals
+	// with escape sequences are materialized once and stored here as well, so several threads may lex one buffer.
+	// The buffer must live as long as any token (or tree) made from it.
+	class SourceBuffer
+	{
+		std::string storage;
+		std::string_view text;
+		std::deque<std::string> materialized;	// deque keeps addresses stable on push_back
+		std::mutex materialized_mutex;
+
+		// Read-only view of the file when the text is mapped instead of stored
+		const char* mapping = nullptr;
+		size_t mapping_size = 0;
+
+		SourceBuffer() = default;
+
+#ifdef _WIN32
+		bool Map(HANDLE file)
+		{
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0) return false;
+			HANDLE section = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!section) return false;
+			void* view = MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(section);	// The view keeps the mapping alive
+			if (!view) return false;
+			mapping = static_cast<const char*>(view);
+			mapping_size = static_cast<size_t>(size.QuadPart);
+			text = std::string_view(mapping, mapping_size);
+			return true;
+		}
+
+		bool ReadAll(HANDLE file)
+		{
+			char buffer[64 * 1024];
+			DWORD count = 0;
+			while (ReadFile(file, buffer, sizeof(buffer), &count, nullptr) && count > 0) storage.append(buffer, count);
+			text = storage;
+			return true;
+		}
+#else
+		bool Map(int file)
+		{
+			struct stat info;
+			if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0) return false;
+			void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+			if (view == MAP_FAILED) return false;
+			madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);	// The lexer reads it front to back
+			mapping = static_cast<const char*>(view);
+			mapping_size = static_cast<size_t>(info.st_size);
+			text = std::string_view(mapping, mapping_size);
+			return true;
+		}
+
+		bool ReadAll(int file)
+		{
+			char buffer[64 * 1024];
+			while (true) {
+				ssize_t count = read(file, buffer, sizeof(buffer));
+				if (count > 0) storage.append(buffer, static_cast<size_t>(count));
+				else if (count == 0) break;
+				else if (errno != EINTR) return false;
+			}
+			text = storage;
+			return true;
+		}
+#endif
+
+	public:
+		explicit SourceBuffer(std::string content) : storage(std::move(content)), text(storage) {}
+
+		//Forbid copying: tokens point into the storage
+		SourceBuffer(const SourceBuffer&) = delete;
+		SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+		~SourceBuffer()
+		{
+			if (!mapping) return;
+#ifdef _WIN32
+			UnmapViewOfFile(mapping);
+#else
+			munmap(const_cast<char*>(mapping), mapping_size);
+#endif
+		}
+
+		static std::shared_ptr<SourceBuffer> FromString(std::string content)
+		{
+			return std::make_shared<SourceBuffer>(std::move(content));
+		}
+
+		// Regular files are mapped, so tokens point straight into the pages of the file.
+		// Pipes, devices and empty files are read into the buffer instead. nullptr if the file can't be opened
+		static std::shared_ptr<SourceBuffer> FromFile(const std::string& filename)
+		{
+			std::shared_ptr<SourceBuffer> buffer(new SourceBuffer());
+#ifdef _WIN32
+			HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE) return nullptr;
+			bool ok = buffer->Map(file) || buffer->ReadAll(file);
+			CloseHandle(file);
+#else
+			int file = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+			if (file < 0) return nullptr;
+			bool ok = buffer->Map(file) || buffer->ReadAll(file);
+			close(file);
+#endif
+			return ok ? buffer : nullptr;
+		}
+
+		bool IsMapped() const { return mapping != nullptr; }
+
+		std::string_view Text() const { return text; }
+		size_t Size() const { return text.size(); }
+
+		std::string_view Materialize(std::string value)
+		{
+			std::lock_guard lock(materialized_mutex);
+			materialized.push_back(std::move(value));
+			return materialized.back();
+		}
+	};
+}
@@ -1,5 +1,8 @@
 #pragma once
 #include "..\Definitions\Types.hpp"
+#include <string_view>
+#include <array>
+#include <cstdint>
 
 
 
@@ -12,7 +15,7 @@ namespace DCL
         NUMBER_LITERAL = 1 << 2,  // 00000100 // Numbers, strings, true/false
         STRING_LITERAL = 1 << 3,  // 00001000 
         BOOL_LITERAL = 1 << 4,   // 00010000
-        DELIMITER = 1 << 5,   // 00100000 //, {}, [],
+        DELIMITER = 1 << 5,   // 00100000 //, {}, [], ()
         END = 1 << 6,   // 01000000 // ;
         KEYWORD = 1 << 7,    // 10000000 //tag
         LITERALS = NUMBER_LITERAL | STRING_LITERAL | BOOL_LITERAL,
@@ -21,67 +24,83 @@ namespace DCL
     };
 	struct Token 
 	{
-		std::string value;
+		std::string_view value;		// Span over the SourceBuffer which produced the token
         TokenType type;
 		size_t line, column;
+		size_t offset = 0;			// Byte offset of the token in the source
 	};
+    // Character classes of the lexer, one table lookup per input byte
+    enum CharClass : uint8_t {
+        CC_NONE = 0,            // Part of identifier or number
+        CC_SPACE = 1 << 0,      // ' ', \t, \v, \f
+        CC_NEWLINE = 1 << 1,    // \n
+        CC_RETURN = 1 << 2,     // \r
+        CC_DELIMITER = 1 << 3,  // , { } [ ] ( )
+        CC_END = 1 << 4,        // ;
+        CC_OPERATOR = 1 << 5,   // + - * / :
+        CC_QUOTE = 1 << 6,      // "
+        CC_DIGIT = 1 << 7,      // 0-9
+    };
+
+    constexpr std::array<uint8_t, 256> MakeCharClassTable() {
+        std::array<uint8_t, 256> table{};
+        for (char c : std::string_view(" \t\v\f")) table[static_cast<unsigned char>(c)] = CC_SPACE;
+        table['\n'] = CC_NEWLINE;
+        table['\r'] = CC_RETURN;
+        for (char c : std::string_view(",{}[]()")) table[static_cast<unsigned char>(c)] = CC_DELIMITER;
+        table[';'] = CC_END;
+        for (char c : std::string_view("+-*/:")) table[static_cast<unsigned char>(c)] = CC_OPERATOR;
+        table['"'] = CC_QUOTE;
+        for (char c = '0'; c <= '9'; c++) table[static_cast<unsigned char>(c)] = CC_DIGIT;
+        return table;
+    }
+    inline constexpr std::array<uint8_t, 256> char_classes = MakeCharClassTable();
+
     class TokenMap {
     private:
-        static const std::unordered_set<std::string>& GetIsOperatorSet() {
-            static std::unordered_set<std::string> map = { "+", "-", "*", "/", ":", "::" };
-            return map;
-        }
-
-        static const std::unordered_map<std::string, TokenType>& GetTokenTypeMap() {
-            static std::unordered_map<std::string, TokenType> map = {
-                {"+",   TokenType::OPERATOR},
-                {"-",   TokenType::OPERATOR},
-                {"*",   TokenType::OPERATOR},
-                {"/",   TokenType::OPERATOR}, 
-                {":",   TokenType::OPERATOR},
-                {"::",  TokenType::OPERATOR},
-                {",",   TokenType::DELIMITER},
-                {"{",   TokenType::DELIMITER},
-                {"}",   TokenType::DELIMITER},
-                {"[",   TokenType::DELIMITER},
-                {"]",   TokenType::DELIMITER},
-                {";",   TokenType::END},        
-                {"tag", TokenType::KEYWORD},
-                {"copy", TokenType::KEYWORD},
-                {"key", TokenType::KEYWORD},
-            };
-            return map;
-        }
+        struct Keyword { std::string_view text; TokenType type; };
+        static constexpr std::array<Keyword, 6> keywords = { {
+            {"::",    TokenType::OPERATOR},
+            {"tag",   TokenType::KEYWORD},
+            {"copy",  TokenType::KEYWORD},
+            {"key",   TokenType::KEYWORD},
+            {"true",  TokenType::BOOL_LITERAL},
+            {"false", TokenType::BOOL_LITERAL},
+        } };
 
     public:
-        static bool IsOperator(const std::string& str) {
-            return GetIsOperatorSet().count(str) > 0;
+        static constexpr uint8_t GetCharClass(char c) {
+            return char_classes[static_cast<unsigned char>(c)];
         }
 
-        static TokenType GetTType(const std::string& str) {
-            auto& map = GetTokenTypeMap();
-            auto it = map.find(str);
-            return it != map.end() ? it->second : TokenType::UDE;
+        static constexpr bool IsOperator(std::string_view str) {
+            return (str.size() == 1 && GetCharClass(str[0]) == CC_OPERATOR) || str == "::";
         }
 
-        //  static
-        static std::string GetOperator(const std::string& code, size_t i) {
-            if (i >= code.size()) return "";
-
-            std::string single_char(1, code[i]);
-            if (!IsOperator(single_char)) return "";
-
-            //   
-            if (i + 1 < code.size()) {
-                std::string two_chars = single_char + code[i + 1];
-                if (IsOperator(two_chars)) return two_chars;
+        // Single-char syntax and keywords, UDE for everything else
+        static constexpr TokenType GetTType(std::string_view str) {
+            if (str.size() == 1) {
+                switch (GetCharClass(str[0])) {
+                case CC_OPERATOR: return TokenType::OPERATOR;
+                case CC_DELIMITER: return TokenType::DELIMITER;
+                case CC_END: return TokenType::END;
+                default: return TokenType::UDE;
+                }
             }
+            for (const auto& keyword : keywords) {
+                if (keyword.text == str) return keyword.type;
+            }
+            return TokenType::UDE;
+        }
 
-            return single_char;
+        // Length of the operator at code[i]: 0 if there is none
+        static constexpr size_t GetOperatorLength(std::string_view code, size_t i) {
+            if (i >= code.size() || GetCharClass(code[i]) != CC_OPERATOR) return 0;
+            if (code[i] == ':' && i + 1 < code.size() && code[i + 1] == ':') return 2;
+            return 1;
         }
 
-        static bool IsNumber(const std::string& str) {
-            //   ( )
+        static constexpr bool IsNumber(std::string_view str) {
             if (str.empty()) return false;
             size_t start = (str[0] == '-') ? 1 : 0;
             if (start >= str.size()) return false;
@@ -92,21 +111,20 @@ namespace DCL
                     if (has_dot) return false; //  
                     has_dot = true;
                 }
-                else if (!std::isdigit(str[i])) {
+                else if (GetCharClass(str[i]) != CC_DIGIT) {
                     return false;
                 }
             }
             return true;
         }
 
-        static TokenType DetermineTokenType(const std::string& value) {
-            //    
+        static constexpr TokenType DetermineTokenType(std::string_view value) {
+            //  ,    
             if (TokenType t = GetTType(value); t != TokenType::UDE)
                 return t;
 
             //  
             if (IsNumber(value)) return TokenType::NUMBER_LITERAL;
-            if (value == "true" || value == "false") return TokenType::BOOL_LITERAL;
 
             //   - 
             return TokenType::IDENTIFIER;